@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "cpu.h"
+#include "arena.h"
+
+// A CPU padded out to whole cache lines
+typedef struct cpu_slot {
+    _Alignas(ARENA_LINE) CPU cpu;
+} cpu_slot;
+
+struct arena {
+    // Memory file holding the start state, and its size in whole pages
+    int fd;
+    size_t chip_bytes;
+
+    // Address space for every instance's chip, chip_bytes apart. Slots
+    // that aren't in use are inaccessible and take no memory.
+    uint8_t* chips;
+
+    cpu_slot* cpus;
+    CPU reset_cpu;
+    int capacity;
+};
+
+// Sets up room for capacity instances starting from c and cpu. No instance
+// is usable until arena_reset. Returns NULL if the memory can't be set up.
+arena* arena_create(const chip* c, const CPU* cpu, int capacity) {
+    arena* a = calloc(1, sizeof(arena));
+    if (a == NULL) {
+        return NULL;
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    a->chip_bytes = (sizeof(chip) + page - 1) / page * page;
+    a->reset_cpu = *cpu;
+    a->capacity = capacity;
+
+    a->fd = memfd_create("chip8-arena", MFD_CLOEXEC);
+    if (a->fd < 0) {
+        free(a);
+        return NULL;
+    }
+    if (ftruncate(a->fd, a->chip_bytes) != 0 || pwrite(a->fd, c, sizeof(chip), 0) != sizeof(chip)) {
+        close(a->fd);
+        free(a);
+        return NULL;
+    }
+
+    a->chips = mmap(NULL, a->chip_bytes * capacity, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    a->cpus = aligned_alloc(ARENA_LINE, capacity * sizeof(cpu_slot));
+    if (a->chips == MAP_FAILED || a->cpus == NULL) {
+        if (a->chips != MAP_FAILED) {
+            munmap(a->chips, a->chip_bytes * capacity);
+        }
+        free(a->cpus);
+        close(a->fd);
+        free(a);
+        return NULL;
+    }
+
+    return a;
+}
+
+void arena_destroy(arena* a) {
+    munmap(a->chips, a->chip_bytes * a->capacity);
+    free(a->cpus);
+    close(a->fd);
+    free(a);
+}
+
+// Puts instance i back at the start state. Mapping the memory file over
+// the old chip throws away every page it wrote, so this costs the same
+// however much the instance had changed. Returns 0 if it can't be mapped.
+int arena_reset(arena* a, int i) {
+    void* p = mmap(a->chips + i * a->chip_bytes, a->chip_bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED, a->fd, 0);
+    if (p == MAP_FAILED) {
+        arena_release(a, i);
+        return 0;
+    }
+
+    a->cpus[i].cpu = a->reset_cpu;
+    return 1;
+}
+
+// Gives back the memory of instance i until it is reset again
+void arena_release(arena* a, int i) {
+    mmap(a->chips + i * a->chip_bytes, a->chip_bytes, PROT_NONE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+}
+
+chip* arena_chip(arena* a, int i) {
+    return (chip*)(a->chips + i * a->chip_bytes);
+}
+
+CPU* arena_cpu(arena* a, int i) {
+    return &a->cpus[i].cpu;
+}
+
+// Memory the instances have written, and so no longer share with the start
+// state, as reported by the kernel. Returns 0 if that can't be read.
+size_t arena_private_bytes(arena* a) {
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    uintptr_t from = (uintptr_t) a->chips;
+    uintptr_t to = from + a->chip_bytes * a->capacity;
+    int inside = 0;
+    size_t total = 0;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long start, end, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            inside = start >= from && end <= to;
+        } else if (inside && sscanf(line, "Private_Dirty: %lu kB", &kb) == 1) {
+            total += kb * 1024;
+        }
+    }
+
+    fclose(f);
+    return total;
+}
@@ -0,0 +1,30 @@
+#include <stddef.h>
+
+// Instance arena: many machines that all start from the same loaded ROM.
+//
+// The start state is written once into a memory file, and every instance's
+// chip is a private copy-on-write mapping of it, so the font, the ROM and
+// the rest of the 64 KB of memory are shared until an instance writes to
+// them, a page at a time. An instance that only draws and keeps its
+// variables in registers owns the one page holding its screen and stack.
+// CPUs live in a separate slab, one cache line each, so instances run on
+// different threads never share a line.
+//
+// Every live instance is its own mapping, so running more than about 65000
+// at once needs vm.max_map_count raised.
+
+// Cache line the CPU slots are aligned to
+#define ARENA_LINE 64
+
+struct chip;
+struct CPU;
+
+typedef struct arena arena;
+
+arena* arena_create(const struct chip* c, const struct CPU* cpu, int capacity);
+void arena_destroy(arena* a);
+int arena_reset(arena* a, int i);
+void arena_release(arena* a, int i);
+struct chip* arena_chip(arena* a, int i);
+struct CPU* arena_cpu(arena* a, int i);
+size_t arena_private_bytes(arena* a);
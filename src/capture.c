@@ -0,0 +1,470 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "capture.h"
+
+// A captured frame: the packed screen plus the 60Hz frame it was taken on
+typedef struct capture_frame_data {
+    uint64_t screen[SCREEN_PLANES][HIRES_HEIGHT][SCREEN_WORDS];
+    uint8_t hires;
+    uint64_t tick;
+} capture_frame_data;
+
+// GIF LZW codes are at most 12 bits
+#define LZW_MAX_CODES 4096
+
+struct capture {
+    FILE* out;
+    capture_options opts;
+    int width;
+    int height;
+    pthread_t writer;
+    atomic_int running;
+
+    // Single-producer/single-consumer frame pool. head and tail count frames;
+    // only the emulator thread writes head and only the writer writes tail.
+    capture_frame_data* pool;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    uint64_t tail_cache;
+
+    // Emulator side
+    uint64_t tick;
+    uint64_t dropped;
+
+    // Writer side: the scaled image as palette indices, and the converted
+    // frame (RGB24 or the three Y4M planes)
+    uint8_t* image;
+    uint8_t* buffer;
+    uint64_t written;
+
+    // Writer side: the last frame converted, or for GIF the frame waiting
+    // for its duration to be known
+    capture_frame_data pending;
+    int has_pending;
+
+    // Writer side, GIF only: time written so far in hundredths of a second,
+    // and the LZW dictionary as a trie over the four colors
+    uint64_t centiseconds;
+    uint16_t lzw_next[LZW_MAX_CODES][4];
+};
+
+// Picks the format from the file extension and fills in the default scale and palette.
+void capture_default_options(capture_options* opts, const char* filename) {
+    const char* ext = strrchr(filename, '.');
+
+    opts->format = CAPTURE_GIF;
+    if (ext != NULL && strcmp(ext, ".y4m") == 0) {
+        opts->format = CAPTURE_Y4M;
+    } else if (ext != NULL && (strcmp(ext, ".raw") == 0 || strcmp(ext, ".rgb") == 0)) {
+        opts->format = CAPTURE_RAW;
+    }
+
+    // Same colors as the window
+    opts->scale = 4;
+    opts->palette[0] = 0x000000;
+    opts->palette[1] = 0xFFFFFF;
+    opts->palette[2] = 0xAAAAAA;
+    opts->palette[3] = 0x555555;
+    opts->wait = 0;
+}
+
+// Parses up to four comma-separated RRGGBB colors, e.g. "000000,ffffff".
+// Colors that aren't given keep their value. Returns 0 if the spec is invalid.
+int parse_palette(const char* spec, uint32_t* palette) {
+    for (int i = 0; i < 4 && *spec != '\0'; i++) {
+        char* end;
+        unsigned long color = strtoul(spec, &end, 16);
+        if (end - spec != 6 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        palette[i] = color;
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return *spec == '\0';
+}
+
+// Expands a frame into palette indices on the scaled canvas.
+static void render_frame(capture* cap, const capture_frame_data* f) {
+    int scale = cap->opts.scale;
+    int shift = f->hires ? 0 : 1;
+
+    for (int y = 0; y < HIRES_HEIGHT; y++) {
+        uint8_t* row = cap->image + (size_t) y * scale * cap->width;
+        int sy = y >> shift;
+
+        for (int x = 0; x < HIRES_WIDTH; x++) {
+            int sx = x >> shift;
+            int bit = 63 - (sx & 63);
+            uint8_t index = (f->screen[0][sy][sx >> 6] >> bit & 1) |
+                            (f->screen[1][sy][sx >> 6] >> bit & 1) << 1;
+            memset(row + x * scale, index, scale);
+        }
+
+        for (int i = 1; i < scale; i++) {
+            memcpy(row + (size_t) i * cap->width, row, cap->width);
+        }
+    }
+}
+
+// Converts the rendered image to planar 4:4:4 YCbCr with BT.601 studio range.
+static void convert_y4m(capture* cap) {
+    uint8_t lut[3][4];
+    for (int i = 0; i < 4; i++) {
+        int r = cap->opts.palette[i] >> 16 & 0xFF;
+        int g = cap->opts.palette[i] >> 8 & 0xFF;
+        int b = cap->opts.palette[i] & 0xFF;
+        lut[0][i] = 16 + (66 * r + 129 * g + 25 * b + 128) / 256;
+        lut[1][i] = 128 + (-38 * r - 74 * g + 112 * b + 128) / 256;
+        lut[2][i] = 128 + (112 * r - 94 * g - 18 * b + 128) / 256;
+    }
+
+    size_t size = (size_t) cap->width * cap->height;
+    for (int plane = 0; plane < 3; plane++) {
+        uint8_t* out = cap->buffer + plane * size;
+        for (size_t i = 0; i < size; i++) {
+            out[i] = lut[plane][cap->image[i]];
+        }
+    }
+}
+
+// Converts the rendered image to packed RGB24.
+static void convert_raw(capture* cap) {
+    size_t size = (size_t) cap->width * cap->height;
+    for (size_t i = 0; i < size; i++) {
+        uint32_t color = cap->opts.palette[cap->image[i]];
+        cap->buffer[i * 3] = color >> 16;
+        cap->buffer[i * 3 + 1] = color >> 8;
+        cap->buffer[i * 3 + 2] = color;
+    }
+}
+
+// LZW output: codes are packed LSB first into sub-blocks of up to 255 bytes
+typedef struct bit_writer {
+    FILE* out;
+    uint32_t bits;
+    int count;
+    uint8_t block[255];
+    int len;
+} bit_writer;
+
+static void put_code(bit_writer* w, int code, int size) {
+    w->bits |= (uint32_t) code << w->count;
+    w->count += size;
+    while (w->count >= 8) {
+        w->block[w->len++] = w->bits & 0xFF;
+        w->bits >>= 8;
+        w->count -= 8;
+        if (w->len == 255) {
+            fputc(255, w->out);
+            fwrite(w->block, 1, 255, w->out);
+            w->len = 0;
+        }
+    }
+}
+
+static void flush_codes(bit_writer* w) {
+    if (w->count > 0) {
+        put_code(w, 0, 8 - w->count);
+    }
+    if (w->len > 0) {
+        fputc(w->len, w->out);
+        fwrite(w->block, 1, w->len, w->out);
+    }
+    fputc(0, w->out);
+}
+
+// The graphic control extension stores the delay in 16 bits
+#define GIF_MAX_DELAY 65535
+
+// Writes the rendered image as one GIF frame shown for the given time.
+static void write_gif(capture* cap, uint16_t centiseconds) {
+    FILE* out = cap->out;
+
+    // Graphic control extension with the frame delay
+    uint8_t control[8] = {0x21, 0xF9, 4, 0, centiseconds & 0xFF, centiseconds >> 8, 0, 0};
+    fwrite(control, 1, sizeof(control), out);
+
+    // Image descriptor covering the whole canvas, using the global palette
+    uint8_t descriptor[10] = {0x2C, 0, 0, 0, 0, cap->width & 0xFF, cap->width >> 8,
+                              cap->height & 0xFF, cap->height >> 8, 0};
+    fwrite(descriptor, 1, sizeof(descriptor), out);
+
+    // Four colors need a minimum code size of 2 bits
+    const int min_size = 2;
+    const int clear = 1 << min_size;
+    const int end = clear + 1;
+    fputc(min_size, out);
+
+    bit_writer w = { .out = out };
+    int size = min_size + 1;
+    int next = end + 1;
+    memset(cap->lzw_next, 0, sizeof(cap->lzw_next));
+    put_code(&w, clear, size);
+
+    size_t pixels = (size_t) cap->width * cap->height;
+    int prefix = cap->image[0];
+    for (size_t i = 1; i < pixels; i++) {
+        int pixel = cap->image[i];
+        if (cap->lzw_next[prefix][pixel]) {
+            prefix = cap->lzw_next[prefix][pixel];
+            continue;
+        }
+
+        put_code(&w, prefix, size);
+        if (next < LZW_MAX_CODES) {
+            cap->lzw_next[prefix][pixel] = next++;
+            if (next > (1 << size) && size < 12) {
+                size++;
+            }
+        } else {
+            // Dictionary full: start over
+            put_code(&w, clear, size);
+            memset(cap->lzw_next, 0, sizeof(cap->lzw_next));
+            size = min_size + 1;
+            next = end + 1;
+        }
+        prefix = pixel;
+    }
+    put_code(&w, prefix, size);
+    put_code(&w, end, size);
+    flush_codes(&w);
+}
+
+static void write_gif_header(capture* cap) {
+    FILE* out = cap->out;
+
+    // Logical screen with a 4-entry global color table
+    fwrite("GIF89a", 1, 6, out);
+    uint8_t screen[7] = {cap->width & 0xFF, cap->width >> 8, cap->height & 0xFF, cap->height >> 8, 0xF1, 0, 0};
+    fwrite(screen, 1, sizeof(screen), out);
+    for (int i = 0; i < 4; i++) {
+        fputc(cap->opts.palette[i] >> 16 & 0xFF, out);
+        fputc(cap->opts.palette[i] >> 8 & 0xFF, out);
+        fputc(cap->opts.palette[i] & 0xFF, out);
+    }
+
+    // Loop forever
+    static const uint8_t loop[19] = {0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+                                     3, 1, 0, 0, 0};
+    fwrite(loop, 1, sizeof(loop), out);
+}
+
+// GIF delays are in hundredths of a second, so frames are timed by the
+// rounded difference of their start times rather than 100/60 each.
+static void flush_gif(capture* cap, uint64_t until_tick) {
+    uint64_t end = until_tick * 100 / 60;
+    uint64_t delay = end - cap->centiseconds;
+
+    // Browsers stretch delays below 2cs, so very short frames wait for the next one
+    if (delay < 2) {
+        return;
+    }
+
+    // Longer frames are repeated, leaving the last piece at least 2cs too
+    render_frame(cap, &cap->pending);
+    while (delay > GIF_MAX_DELAY) {
+        uint64_t part = delay - GIF_MAX_DELAY < 2 ? GIF_MAX_DELAY - 2 : GIF_MAX_DELAY;
+        write_gif(cap, part);
+        cap->written++;
+        delay -= part;
+    }
+    write_gif(cap, delay);
+    cap->centiseconds = end;
+    cap->written++;
+    cap->has_pending = 0;
+}
+
+static void write_frame(capture* cap, const capture_frame_data* f, uint64_t* next_tick) {
+    // Identical frames reuse the last conversion (or, for GIF, just extend
+    // the pending frame's duration)
+    int same = cap->has_pending && cap->pending.hires == f->hires &&
+               memcmp(cap->pending.screen, f->screen, sizeof(f->screen)) == 0;
+
+    if (cap->opts.format == CAPTURE_GIF) {
+        if (same) {
+            return;
+        }
+        if (cap->has_pending) {
+            flush_gif(cap, f->tick);
+        }
+
+        // A pending frame too short to show is replaced by the newer one
+        cap->pending = *f;
+        cap->has_pending = 1;
+        return;
+    }
+
+    if (!same) {
+        render_frame(cap, f);
+        if (cap->opts.format == CAPTURE_Y4M) {
+            convert_y4m(cap);
+        } else {
+            convert_raw(cap);
+        }
+        cap->pending = *f;
+        cap->has_pending = 1;
+    }
+
+    // Constant frame rate: fill any dropped ticks with this frame
+    size_t size = (size_t) cap->width * cap->height * 3;
+    do {
+        if (cap->opts.format == CAPTURE_Y4M) {
+            fputs("FRAME\n", cap->out);
+        }
+        fwrite(cap->buffer, 1, size, cap->out);
+        cap->written++;
+        (*next_tick)++;
+    } while (*next_tick <= f->tick);
+}
+
+// Drains the frame pool into the output until capture stops.
+static void* capture_writer(void* arg) {
+    capture* cap = arg;
+    uint64_t next_tick = 0;
+    uint64_t last_tick = 0;
+
+    for (;;) {
+        int running = atomic_load_explicit(&cap->running, memory_order_acquire);
+        uint64_t head = atomic_load_explicit(&cap->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+
+        if (head == tail) {
+            if (!running) {
+                break;
+            }
+            usleep(1000);
+            continue;
+        }
+
+        capture_frame_data* f = &cap->pool[tail % CAPTURE_POOL];
+        if (tail == 0) {
+            next_tick = f->tick;
+        }
+        last_tick = f->tick;
+        write_frame(cap, f, &next_tick);
+
+        atomic_store_explicit(&cap->tail, tail + 1, memory_order_release);
+    }
+
+    if (cap->opts.format == CAPTURE_GIF) {
+        // The last frame is shown for at least one frame time
+        if (cap->has_pending) {
+            uint64_t end = last_tick + 1;
+            while (cap->has_pending) {
+                flush_gif(cap, end++);
+            }
+        }
+        fputc(0x3B, cap->out);
+    }
+
+    return NULL;
+}
+
+// Opens a capture file and starts its background writer. NULL options pick
+// the defaults for the file's extension. Returns NULL on failure.
+capture* capture_open(const char* filename, capture_options* opts) {
+    capture* cap = calloc(1, sizeof(capture));
+    if (cap == NULL) {
+        return NULL;
+    }
+
+    if (opts != NULL) {
+        cap->opts = *opts;
+    } else {
+        capture_default_options(&cap->opts, filename);
+    }
+    if (cap->opts.scale < 1 || cap->opts.scale > CAPTURE_MAX_SCALE) {
+        free(cap);
+        return NULL;
+    }
+    cap->width = HIRES_WIDTH * cap->opts.scale;
+    cap->height = HIRES_HEIGHT * cap->opts.scale;
+
+    size_t pixels = (size_t) cap->width * cap->height;
+    cap->pool = malloc(CAPTURE_POOL * sizeof(capture_frame_data));
+    cap->image = malloc(pixels);
+    cap->buffer = malloc(pixels * 3);
+    cap->out = fopen(filename, "wb");
+    if (cap->pool == NULL || cap->image == NULL || cap->buffer == NULL || cap->out == NULL) {
+        if (cap->out != NULL) {
+            fclose(cap->out);
+        }
+        free(cap->pool);
+        free(cap->image);
+        free(cap->buffer);
+        free(cap);
+        return NULL;
+    }
+
+    // Headers go straight out; the writer is not running yet
+    if (cap->opts.format == CAPTURE_GIF) {
+        write_gif_header(cap);
+    } else if (cap->opts.format == CAPTURE_Y4M) {
+        fprintf(cap->out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", cap->width, cap->height, FRAMES_PER_SECOND);
+    }
+
+    atomic_store(&cap->running, 1);
+    if (pthread_create(&cap->writer, NULL, capture_writer, cap) != 0) {
+        fclose(cap->out);
+        free(cap->pool);
+        free(cap->image);
+        free(cap->buffer);
+        free(cap);
+        return NULL;
+    }
+
+    return cap;
+}
+
+// Captures the current screen as the next 60Hz frame. This is a 2KB copy;
+// if the writer has fallen CAPTURE_POOL frames behind the frame is dropped,
+// unless the capture was opened to wait.
+void capture_frame(capture* cap, chip* c) {
+    uint64_t tick = cap->tick++;
+    uint64_t head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+
+    while (head - cap->tail_cache >= CAPTURE_POOL) {
+        cap->tail_cache = atomic_load_explicit(&cap->tail, memory_order_acquire);
+        if (head - cap->tail_cache < CAPTURE_POOL) {
+            break;
+        }
+        if (!cap->opts.wait) {
+            cap->dropped++;
+            return;
+        }
+        sched_yield();
+    }
+
+    capture_frame_data* f = &cap->pool[head % CAPTURE_POOL];
+    memcpy(f->screen, c->game_screen, sizeof(f->screen));
+    f->hires = c->hires;
+    f->tick = tick;
+
+    atomic_store_explicit(&cap->head, head + 1, memory_order_release);
+}
+
+// Writes out the remaining frames and closes the file. Returns the number
+// of frames written, and the number dropped through dropped if not NULL.
+uint64_t capture_close(capture* cap, uint64_t* dropped) {
+    atomic_store_explicit(&cap->running, 0, memory_order_release);
+    pthread_join(cap->writer, NULL);
+    fclose(cap->out);
+
+    uint64_t written = cap->written;
+    if (dropped != NULL) {
+        *dropped = cap->dropped;
+    }
+
+    free(cap->pool);
+    free(cap->image);
+    free(cap->buffer);
+    free(cap);
+
+    return written;
+}
@@ -0,0 +1,45 @@
+#include <inttypes.h>
+
+// Video capture of the emulated display. The emulator thread copies the
+// packed screen into a preallocated frame pool once per 60Hz frame; a worker
+// thread scales, converts and writes the frames, so encoding never runs on
+// the emulator thread.
+//
+// Every output format uses a fixed canvas of HIRES_WIDTH x HIRES_HEIGHT
+// pixels times the scale, with low resolution pixels doubled, so resolution
+// switches don't change the video size.
+#define CAPTURE_GIF 0 // Animated GIF, identical frames merged
+#define CAPTURE_Y4M 1 // YUV4MPEG2 4:4:4 at 60fps
+#define CAPTURE_RAW 2 // Headerless RGB24 frames at 60fps
+
+// Frames the emulator can run ahead of the writer
+#define CAPTURE_POOL 128
+
+#define CAPTURE_MAX_SCALE 16
+
+struct chip;
+
+typedef struct capture_options {
+    // One of the CAPTURE_* formats
+    int format;
+
+    // Output pixels per hires pixel, 1 to CAPTURE_MAX_SCALE
+    int scale;
+
+    // 0xRRGGBB colors for each combination of the two bitplanes
+    uint32_t palette[4];
+
+    // If set, capture_frame waits for the writer when the pool is full
+    // instead of dropping the frame. Headless runs that must not lose frames
+    // set this; the interactive frontend doesn't.
+    int wait;
+} capture_options;
+
+typedef struct capture capture;
+
+void capture_default_options(capture_options* opts, const char* filename);
+int parse_palette(const char* spec, uint32_t* palette);
+
+capture* capture_open(const char* filename, capture_options* opts);
+void capture_frame(capture* cap, struct chip* c);
+uint64_t capture_close(capture* cap, uint64_t* dropped);
@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "state.h"
+#include "lockstep.h"
+#include "quirks.h"
+
+#define MAX_INPUT_EVENTS 65536
+
+// Reads "<frame> <hex keypad mask>" lines ('#' starts a comment). Returns
+// the number of events, or -1 if the file can't be read or isn't sorted.
+static int load_input(const char* filename, key_event* events) {
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[128];
+    int count = 0;
+    while (fgets(line, sizeof(line), f) != NULL && count < MAX_INPUT_EVENTS) {
+        unsigned long long frame;
+        unsigned int keys;
+        if (line[0] == '#' || sscanf(line, "%llu %x", &frame, &keys) != 2) {
+            continue;
+        }
+        if (count > 0 && frame < events[count - 1].frame) {
+            fclose(f);
+            return -1;
+        }
+        events[count].frame = frame;
+        events[count].keys = keys;
+        count++;
+    }
+
+    fclose(f);
+    return count;
+}
+
+// Makes up key presses: one key at a time, held for a few frames, with gaps in between.
+static int random_input(uint32_t seed, uint64_t frames, key_event* events) {
+    uint32_t x = seed != 0 ? seed : 1;
+    int count = 0;
+
+    for (uint64_t frame = 0; frame < frames && count + 2 <= MAX_INPUT_EVENTS;) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        frame += 5 + x % 40;
+        events[count].frame = frame;
+        events[count].keys = 1 << (x >> 8 & 0xF);
+        count++;
+
+        frame += 2 + (x >> 16) % 15;
+        events[count].frame = frame;
+        events[count].keys = 0;
+        count++;
+    }
+
+    return count;
+}
+
+static int write_snapshot(const char* prefix, const char* suffix, const snapshot* s) {
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s.%s", prefix, suffix);
+
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL) {
+        return 0;
+    }
+    int ok = fwrite(s, sizeof(snapshot), 1, f) == 1;
+    fclose(f);
+    return ok;
+}
+
+// Runs two execution backends in lockstep and reports where they diverge:
+//   chip8-check [-a backend] [-b backend] [-n instructions] [-c interval]
+//               [-i instructions per frame] [-m mode] [-q quirks] [-k input | -r seed]
+//               [-d dump prefix] [-l] rom
+// Without -b, backend a is checked against every other backend. Exits with
+// 1 if any pair diverged.
+int main(int argc, char** argv) {
+    const backend* a = find_backend("cycle");
+    const backend* b = NULL;
+    lockstep_options opts = {
+        .instructions = 10000000,
+        .interval = 10000,
+        .instructions_per_frame = CPU_CLOCK_SPEED / FRAMES_PER_SECOND,
+    };
+    uint8_t mode = MODE_CHIP8;
+    int quirks = -1;
+    const char* input_file = NULL;
+    uint32_t seed = 0;
+    const char* dump_prefix = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:b:n:c:i:m:q:k:r:d:l")) != -1) {
+        switch (opt) {
+            case 'a':
+            case 'b':
+                if (find_backend(optarg) == NULL) {
+                    fprintf(stderr, "Unknown backend %s (see -l)\n", optarg);
+                    return 2;
+                }
+                if (opt == 'a') {
+                    a = find_backend(optarg);
+                } else {
+                    b = find_backend(optarg);
+                }
+                break;
+            case 'n':
+                opts.instructions = strtoull(optarg, NULL, 10);
+                break;
+            case 'c':
+                opts.interval = strtoull(optarg, NULL, 10);
+                break;
+            case 'i':
+                opts.instructions_per_frame = atoi(optarg);
+                break;
+            case 'm':
+                if (strcmp(optarg, "schip") == 0) {
+                    mode = MODE_SCHIP;
+                } else if (strcmp(optarg, "xochip") == 0) {
+                    mode = MODE_XOCHIP;
+                } else if (strcmp(optarg, "chip8") != 0) {
+                    fprintf(stderr, "Unknown mode %s (chip8, schip or xochip)\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'q':
+                quirks = parse_quirks(optarg);
+                if (quirks < 0) {
+                    fprintf(stderr, "Unknown quirk profile %s (modern, vip, schip or xochip)\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'k':
+                input_file = optarg;
+                break;
+            case 'r':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                dump_prefix = optarg;
+                break;
+            case 'l':
+                for (const backend* be = backends; be->name != NULL; be++) {
+                    printf("%s\n", be->name);
+                }
+                return 0;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (optind != argc - 1 || opts.interval < 1 || opts.instructions_per_frame < 1) {
+        fprintf(stderr, "usage: %s [-a backend] [-b backend] [-n instructions] [-c interval] "
+                        "[-i instructions per frame] [-m mode] [-q quirks] [-k input | -r seed] [-d dump prefix] [-l] rom\n",
+                argv[0]);
+        return 2;
+    }
+
+    FILE* f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open ROM %s\n", argv[optind]);
+        return 2;
+    }
+    fclose(f);
+
+    key_event* input = malloc(MAX_INPUT_EVENTS * sizeof(key_event));
+    opts.input = input;
+    if (input_file != NULL) {
+        opts.input_count = load_input(input_file, input);
+        if (opts.input_count < 0) {
+            fprintf(stderr, "Could not read input from %s\n", input_file);
+            return 2;
+        }
+    } else if (seed != 0) {
+        opts.input_count = random_input(seed, opts.instructions / opts.instructions_per_frame, input);
+    }
+
+    // Everything starts from the same freshly loaded machine
+    snapshot* start = malloc(sizeof(snapshot));
+    chip* c = init();
+    c->mode = mode;
+    load_rom(c, argv[optind]);
+    c->quirks = quirks >= 0 ? quirks : select_quirks(argv[optind], mode);
+    CPU* cpu = initialize();
+    snapshot_save(start, c, cpu);
+    free(cpu);
+    free(c);
+
+    snapshot* states = malloc(2 * sizeof(snapshot));
+    int failed = 0;
+
+    for (const backend* other = backends; other->name != NULL; other++) {
+        if ((b != NULL && other != b) || (b == NULL && other == a)) {
+            continue;
+        }
+
+        lockstep_result result;
+        if (!lockstep_run(a, other, start, &opts, &result, states)) {
+            fprintf(stderr, "Could not start backends %s and %s\n", a->name, other->name);
+            return 2;
+        }
+
+        if (!result.diverged) {
+            printf("%s vs %s: %" PRIu64 " instructions match\n", a->name, other->name, result.checked);
+            continue;
+        }
+
+        failed = 1;
+        printf("%s vs %s: diverged at instruction %" PRIu64 " (PC %04X, opcode %04X)\n",
+               a->name, other->name, result.instruction, result.pc, result.opcode);
+        printf("State after it (A = %s, B = %s):\n", a->name, other->name);
+        state_dump_diff(stdout, &states[0], &states[1]);
+
+        if (dump_prefix != NULL) {
+            char suffix[64];
+            snprintf(suffix, sizeof(suffix), "%s.state", a->name);
+            int ok = write_snapshot(dump_prefix, suffix, &states[0]);
+            snprintf(suffix, sizeof(suffix), "%s.state", other->name);
+            ok = ok && write_snapshot(dump_prefix, suffix, &states[1]);
+            if (!ok) {
+                fprintf(stderr, "Could not write states to %s.*\n", dump_prefix);
+            }
+        }
+    }
+
+    free(states);
+    free(start);
+    free(input);
+
+    return failed;
+}
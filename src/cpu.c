@@ -3,43 +3,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/time.h>
-#include <unistd.h>
 #include "cpu.h"
 // #include "mem.h"
 
-void putpixel(SDL_Surface *surface, int x, int y, uint32_t pixel) {
-    int bpp = surface->format->BytesPerPixel;
-    /* Here p is the address to the pixel we want to set */
-    uint8_t *p = (uint8_t *)surface->pixels + y * surface->pitch + x * bpp;
-
-    switch(bpp) {
-    case 1:
-        *p = pixel;
-        break;
-
-    case 2:
-        *(uint16_t *)p = pixel;
-        break;
-
-    case 3:
-        if(SDL_BYTEORDER == SDL_BIG_ENDIAN) {
-            p[0] = (pixel >> 16) & 0xff;
-            p[1] = (pixel >> 8) & 0xff;
-            p[2] = pixel & 0xff;
-        } else {
-            p[0] = pixel & 0xff;
-            p[1] = (pixel >> 8) & 0xff;
-            p[2] = (pixel >> 16) & 0xff;
-        }
-        break;
-
-    case 4:
-        *(uint32_t *)p = pixel;
-        break;
-    }
-}
-
 // Initializes the register values for the CPU.
 CPU* initialize() {
     CPU* cpu = (CPU*) malloc(sizeof(CPU));
@@ -59,160 +25,100 @@ CPU* initialize() {
     cpu->sp = 0;
     cpu->dt = 0;
     cpu->st = 0;
+    cpu->rng = CPU_RNG_SEED;
 
     return cpu;
 }
 
-// Emulates the CHIP8 CPU. You can choose to initialize the CPU struct
-// from outside the run() method, which in that case you bear the responsibility
-// of tearing it down.
-void run(chip* c, CPU* cpu) {
-    // Initialize CPU
-    int is_cpu_provided = 1;
-    if (cpu == NULL) {
-        cpu = initialize();
-        is_cpu_provided = 0;
-    }
-
-    // Initialize graphics
-    if (SDL_Init(SDL_INIT_VIDEO) != 0){
-        // printf("SDL_Init Error: %s", SDL_GetError());
-        return;
-    }
-
-    SDL_Window *win = SDL_CreateWindow("CHIP-8 Emulator", 100, 100, SCREEN_WIDTH * 10, SCREEN_HEIGHT * 10, SDL_WINDOW_SHOWN);
-    SDL_Renderer *ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    SDL_Surface *surface = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 8, 0, 0, 0, 0);
-    SDL_Palette *palette = SDL_AllocPalette(2);
-    if (win == NULL || ren == NULL || surface == NULL || palette == NULL) {
-        SDL_Log("SDL initialization failed: %s", SDL_GetError());
-        exit(1);
-    }
-
-    // CHIP-8 graphics are black/white, so only include two colors in the palette
-    SDL_Color colors[2];
-    SDL_Color white = {0,0,0,0};
-    SDL_Color black = {255, 255, 255, 255};
-    colors[0] = white;
-    colors[1] = black;
-    SDL_SetPaletteColors(palette, colors, 0, 2);
-
-    // Set surface palette
-    SDL_SetSurfacePalette(surface, palette);
-
-    // Keep track of cycle execution time
-    struct timeval cpu_clock_before, timer_clock_before, screen_clock_before, current_time;
-
-    // Handle keyboard/mouse input
-    SDL_Event event;
-
-    // The window surface's pixels are set to our in-memory representation,
-    // so all modifications to the memory are then reflected in the graphics
-    // themselves.
-    SDL_LockSurface(surface);
-    surface->pixels = c->game_screen;
-    SDL_UnlockSurface(surface);
+void print_stuff(uint16_t data, CPU* cpu) {
+    // printf("hex representation: %x\n", data);
+    // printf("v0: %d\n", cpu->v[0]);
+    // printf("v1: %d\n", cpu->v[1]);
+    // printf("v3: %d\n\n", cpu->v[3]);
+}
 
-    // Starting time
-    gettimeofday(&cpu_clock_before, NULL);
-    gettimeofday(&timer_clock_before, NULL);
-    gettimeofday(&screen_clock_before, NULL);
+// Behaviour of each quirk profile. The interpreter below is instantiated once
+// per profile with these as constants, so once optimized (every target that
+// links this builds with -O2) the quirk checks fold away and the specialized
+// handlers contain no quirk branches.
+const quirks quirk_profiles[QUIRK_PROFILES] = {
+    [QUIRKS_MODERN] = {0},
+    [QUIRKS_VIP] = {.shift_vy = 1, .increment_i = 1, .vf_reset = 1},
+    [QUIRKS_SCHIP] = {.jump_vx = 1},
+    [QUIRKS_XOCHIP] = {.shift_vy = 1, .increment_i = 1, .wrap_sprites = 1},
+};
 
-    // CPU fetch/decode/execute loop
-    for(;;) {
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
 
-        // Exit program
-        if (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                exit(1);
-            }
-        }
-    
-        // Run CPU cycle
-        uint16_t opcode = cycle(c, cpu);
-
-        // Redraw screen; make the program wait until a full frame has passed so the emulator doesn't exceed
-        // the expected speed of the original hardware.
-        gettimeofday(&current_time, NULL);
-        if (opcode == 0xD000) {
-            // First clear the renderer
-            SDL_RenderClear(ren);
-
-            // Grab texture from surface
-            SDL_Texture *tex = SDL_CreateTextureFromSurface(ren, surface);
-
-            // Draw the texture
-            SDL_RenderCopy(ren, tex, NULL, NULL);
-
-            // Update the screen
-            SDL_RenderPresent(ren);
-
-        } else {
-            // Sound/delay timer
-            float timer_wait_time = (1000000.0 / TIMER_CLOCK_SPEED) - (current_time.tv_usec - timer_clock_before.tv_usec);
-            if (timer_wait_time <= 0) {
-                if (cpu->dt > 0) {
-                    cpu->dt--;
-                }
+ALWAYS_INLINE uint16_t execute_with(chip* c, CPU* cpu, uint16_t data, const quirks q);
+ALWAYS_INLINE void draw_sprite(chip* c, CPU* cpu, opcode_params* params, int wrap);
 
-                if (cpu->st > 0) {
-                    // TODO: play CHIP-8 sound
-                    printf("\a");
-
-                    cpu->st--;
-                }
-
-                gettimeofday(&timer_clock_before, NULL);
-            }
-        }
+// Reads the opcode at the program counter and steps past it.
+ALWAYS_INLINE uint16_t fetch(chip* c, CPU* cpu) {
+    uint16_t data = (uint16_t)(c->mem[cpu->pc] << 8 | c->mem[(uint16_t)(cpu->pc + 1)]);
+    cpu->pc += 2;
+    return data;
+}
 
-        float cpu_wait_time = (1000000.0 / CPU_CLOCK_SPEED) - (current_time.tv_usec - cpu_clock_before.tv_usec);
-        if (cpu_wait_time > 0) {
-            usleep(cpu_wait_time);
-            gettimeofday(&cpu_clock_before, NULL);
-        }
+// One fetch and execute per profile
+#define PROFILE_CYCLE(name, profile) \
+    static uint16_t execute_##name(chip* c, CPU* cpu, uint16_t data) { \
+        return execute_with(c, cpu, data, quirk_profiles[profile]); \
+    } \
+    static uint16_t cycle_##name(chip* c, CPU* cpu) { \
+        if (c->halted) { \
+            return 0; \
+        } \
+        return execute_##name(c, cpu, fetch(c, cpu)); \
     }
 
-    // Teardown
-    if (!is_cpu_provided) {
-        free(cpu);
-    }
+PROFILE_CYCLE(modern, QUIRKS_MODERN)
+PROFILE_CYCLE(vip, QUIRKS_VIP)
+PROFILE_CYCLE(schip, QUIRKS_SCHIP)
+PROFILE_CYCLE(xochip, QUIRKS_XOCHIP)
+
+static uint16_t (*const cycles[QUIRK_PROFILES])(chip*, CPU*) = {
+    [QUIRKS_MODERN] = cycle_modern,
+    [QUIRKS_VIP] = cycle_vip,
+    [QUIRKS_SCHIP] = cycle_schip,
+    [QUIRKS_XOCHIP] = cycle_xochip,
+};
+
+static uint16_t (*const executes[QUIRK_PROFILES])(chip*, CPU*, uint16_t) = {
+    [QUIRKS_MODERN] = execute_modern,
+    [QUIRKS_VIP] = execute_vip,
+    [QUIRKS_SCHIP] = execute_schip,
+    [QUIRKS_XOCHIP] = execute_xochip,
+};
 
-    SDL_FreePalette(palette);
-    SDL_FreeSurface(surface);
-    SDL_DestroyRenderer(ren);
-    SDL_DestroyWindow(win);
-    SDL_Quit();
+// Represents a single CPU clock cycle. Returns the opcode that was
+// executed during the cycle. Runs the interpreter specialized for the
+// chip's quirk profile.
+uint16_t cycle(chip* c, CPU *cpu) {
+    return cycles[c->quirks](c, cpu);
 }
 
-void print_stuff(uint16_t data, CPU* cpu) {
-    // printf("hex representation: %x\n", data);
-    // printf("v0: %d\n", cpu->v[0]);
-    // printf("v1: %d\n", cpu->v[1]);
-    // printf("v3: %d\n\n", cpu->v[3]);
+uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
+    return executes[c->quirks](c, cpu, data);
 }
 
-// Represents a single CPU clock cycle. Returns the opcode that was
-// executed during the cycle.
-uint16_t cycle(chip* c, CPU *cpu) {
-    // Don't do anything if the SP exceeds the mem
-    if (cpu->pc >= EMU_MEMORY) {
+// Same as cycle(), but with the quirks read from the profile table at run
+// time. Much slower; kept as a reference for lockstep checking of the
+// specialized interpreters.
+__attribute__((noinline))
+uint16_t cycle_generic(chip* c, CPU* cpu) {
+    if (c->halted) {
         return 0;
     }
-
-    // Read the opcode at the program counter address
-    uint16_t data = (uint16_t)(c->mem[cpu->pc] << 8 | c->mem[cpu->pc + 1]);
-
-    // Increment program counter to go to the next opcode
-    cpu->pc += 2;
-
-    // Execute the instruction
-    return execute(c, cpu, data);
+    return execute_with(c, cpu, fetch(c, cpu), quirk_profiles[c->quirks]);
 }
 
-uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
+// Decodes and runs a single instruction with the given quirks. Always inlined
+// into a caller that passes a constant profile.
+ALWAYS_INLINE uint16_t execute_with(chip* c, CPU* cpu, uint16_t data, const quirks q) {
     // Decode opcode parameters
-    opcode_params* params = decode_params(data);
+    opcode_params decoded = {(data & 0x0F00) >> 8, (data & 0x00F0) >> 4, data & 0x00FF};
+    opcode_params* params = &decoded;
     // printf("[LOC %d]:   %x ", cpu->pc - 2, data);
 
     switch(data & 0xF000) {
@@ -223,7 +129,32 @@ uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
                     break;
                 case 0x00E0:
                     opcode_0x00e0(c);
+                    return 0xD000;
+                case 0x00FB:
+                    opcode_0x00fb(c);
+                    return 0xD000;
+                case 0x00FC:
+                    opcode_0x00fc(c);
+                    return 0xD000;
+                case 0x00FD:
+                    opcode_0x00fd(c);
                     break;
+                case 0x00FE:
+                    opcode_0x00fe(c);
+                    return 0xD000;
+                case 0x00FF:
+                    opcode_0x00ff(c);
+                    return 0xD000;
+                default:
+                    // Scrolls report themselves like draws so the frontend redraws
+                    if ((data & 0x00F0) == 0x00C0) {
+                        opcode_0x00cn(c, params);
+                        return 0xD000;
+                    }
+                    if ((data & 0x00F0) == 0x00D0) {
+                        opcode_0x00dn(c, params);
+                        return 0xD000;
+                    }
             }
             break;
         case 0x1000:
@@ -233,13 +164,23 @@ uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
             opcode_0x2000(c, cpu, params);
             break;
         case 0x3000:
-            opcode_0x3000(cpu, params);
+            opcode_0x3000(c, cpu, params);
             break;
         case 0x4000:
-            opcode_0x4000(cpu, params);
+            opcode_0x4000(c, cpu, params);
             break;
         case 0x5000:
-            opcode_0x5000(cpu, params);
+            switch(data & 0x000F) {
+                case 0x0000:
+                    opcode_0x5000(c, cpu, params);
+                    break;
+                case 0x0002:
+                    opcode_0x5xy2(c, cpu, params);
+                    break;
+                case 0x0003:
+                    opcode_0x5xy3(c, cpu, params);
+                    break;
+            }
             break;
         case 0x6000:
             opcode_0x6000(cpu, params);
@@ -254,12 +195,21 @@ uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
                     break;
                 case 0x0001:
                     opcode_0x8xy1(cpu, params);
+                    if (q.vf_reset) {
+                        cpu->v[0xf] = 0;
+                    }
                     break;
                 case 0x0002:
                     opcode_0x8xy2(cpu, params);
+                    if (q.vf_reset) {
+                        cpu->v[0xf] = 0;
+                    }
                     break;
                 case 0x0003:
                     opcode_0x8xy3(cpu, params);
+                    if (q.vf_reset) {
+                        cpu->v[0xf] = 0;
+                    }
                     break;
                 case 0x0004:
                     opcode_0x8xy4(cpu, params);
@@ -268,48 +218,68 @@ uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
                     opcode_0x8xy5(cpu, params);
                     break;
                 case 0x0006:
+                    // Shifting Vy into Vx is shifting a copy of Vy in place
+                    if (q.shift_vy) {
+                        cpu->v[params->x] = cpu->v[params->y];
+                    }
                     opcode_0x8xy6(cpu, params);
                     break;
                 case 0x0007:
                     opcode_0x8xy7(cpu, params);
                     break;
                 case 0x000e:
+                    if (q.shift_vy) {
+                        cpu->v[params->x] = cpu->v[params->y];
+                    }
                     opcode_0x8xye(cpu, params);
                     break;
             }
             break;
         case 0x9000:
-            opcode_0x9000(cpu, params);
+            opcode_0x9000(c, cpu, params);
             break;
         case 0xA000:
             opcode_0xa000(cpu, params);
             break;
         case 0xB000:
-            opcode_0xb000(cpu, params);
+            if (q.jump_vx) {
+                opcode_0xbxnn(cpu, params);
+            } else {
+                opcode_0xb000(cpu, params);
+            }
             break;
         case 0xC000:
             opcode_0xc000(cpu, params);
             break;
         case 0xD000:
-            opcode_0xd000(c, cpu, params);
+            draw_sprite(c, cpu, params, q.wrap_sprites);
             return 0xD000;
         case 0xE000:
             switch(data & 0xF0FF) {
                 case 0xE09E:
-                    opcode_0xex9e(cpu, params);
+                    opcode_0xex9e(c, cpu, params);
                     break;
                 case 0xE0A1:
-                    opcode_0xexa1(cpu, params);
+                    opcode_0xexa1(c, cpu, params);
                     break;
             }
             break;
         case 0xF000:
             switch(data & 0xF0FF) {
+                case 0xF000:
+                    opcode_0xf000(c, cpu);
+                    break;
+                case 0xF001:
+                    opcode_0xfn01(c, params);
+                    break;
+                case 0xF002:
+                    opcode_0xf002(c, cpu);
+                    break;
                 case 0xF007:
                     opcode_0xfx07(cpu, params);
                     break;
                 case 0xF00a:
-                    opcode_0xfx0a(cpu, params);
+                    opcode_0xfx0a(c, cpu, params);
                     break;
                 case 0xF015:
                     opcode_0xfx15(cpu, params);
@@ -321,16 +291,34 @@ uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
                     opcode_0xfx1e(cpu, params);
                     break;
                 case 0xF029:
-                    opcode_0xfx29(c, cpu, params);
+                    opcode_0xfx29(cpu, params);
+                    break;
+                case 0xF030:
+                    opcode_0xfx30(cpu, params);
                     break;
                 case 0xF033:
                     opcode_0xfx33(c, cpu, params);
                     break;
+                case 0xF03A:
+                    opcode_0xfx3a(c, cpu, params);
+                    break;
                 case 0xF055:
                     opcode_0xfx55(c, cpu, params);
+                    if (q.increment_i) {
+                        cpu->address += params->x + 1;
+                    }
                     break;
                 case 0xF065:
                     opcode_0xfx65(c, cpu, params);
+                    if (q.increment_i) {
+                        cpu->address += params->x + 1;
+                    }
+                    break;
+                case 0xF075:
+                    opcode_0xfx75(c, cpu, params);
+                    break;
+                case 0xF085:
+                    opcode_0xfx85(c, cpu, params);
                     break;
                 default:
                     printf("ERROR: OpCode %x not recognized.\n\n", data);
@@ -343,6 +331,60 @@ uint16_t execute(chip* c, CPU* cpu, uint16_t data) {
     return data;
 }
 
+// Skips the next instruction, which is 4 bytes long for XO-CHIP's F000 nnnn.
+static void skip_next(chip* c, CPU* cpu) {
+    if (c->mode == MODE_XOCHIP && c->mem[cpu->pc] == 0xF0 && c->mem[(uint16_t)(cpu->pc + 1)] == 0x00) {
+        cpu->pc += 4;
+    } else {
+        cpu->pc += 2;
+    }
+}
+
+// Returns the number of bytes the given instruction stores to memory starting at I.
+int stored_bytes(uint16_t data) {
+    int x = (data & 0x0F00) >> 8;
+    int y = (data & 0x00F0) >> 4;
+
+    switch (data & 0xF0FF) {
+        case 0xF033:
+            return 3;
+        case 0xF055:
+            return x + 1;
+    }
+    if ((data & 0xF00F) == 0x5002) {
+        return (x > y ? x - y : y - x) + 1;
+    }
+
+    return 0;
+}
+
+// Stops the machine, leaving the PC on the instruction that faulted.
+static void raise_fault(chip* c, CPU* cpu, uint8_t fault) {
+    c->fault = fault;
+    c->halted = 1;
+    cpu->pc -= 2;
+}
+
+const char* fault_name(int fault) {
+    switch (fault) {
+        case FAULT_NONE:
+            return "no fault";
+        case FAULT_STACK_OVERFLOW:
+            return "stack overflow";
+        case FAULT_STACK_UNDERFLOW:
+            return "stack underflow";
+    }
+    return "unknown fault";
+}
+
+int screen_width(chip* c) {
+    return c->hires ? HIRES_WIDTH : SCREEN_WIDTH;
+}
+
+int screen_height(chip* c) {
+    return c->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+}
+
 opcode_params* decode_params(uint16_t data) {
     opcode_params* params = malloc(sizeof(struct opcode_params));
 
@@ -377,76 +419,168 @@ void opcode_0x8xy4(CPU* cpu, opcode_params* params) {
     // printf("ADD V%d, V%d\n", params->x, params->y);
     uint16_t sum = cpu->v[params->x] + cpu->v[params->y];
 
-    // Lowest 8 bits are added to the Vx register, modify carry register as needed
-    if (sum > 255) {
-        cpu->v[0xf] = 1;
-    }
-
+    // Lowest 8 bits are added to the Vx register, and Vf is the carry. The
+    // flag is written last, so it wins when x is F.
     cpu->v[params->x] = (uint8_t)(sum & 255);
+    cpu->v[0xf] = sum > 255;
 }
 
 void opcode_0x8xy5(CPU* cpu, opcode_params* params) {
     // printf("SUB V%d, V%d\n", params->x, params->y);
 
-    // Set carry bit to 1 if Vx > Vy and 0 otherwise
-    if (cpu->v[params->x] > cpu->v[params->y]) {
-        cpu->v[0xf] = 1;
-    } else {
-        cpu->v[0xf] = 0;
-    }
+    // Set carry bit to 1 if there is no borrow (Vx >= Vy) and 0 otherwise
+    uint8_t carry = cpu->v[params->x] >= cpu->v[params->y];
 
     cpu->v[params->x] -= cpu->v[params->y];
+    cpu->v[0xf] = carry;
 }
 
 void opcode_0x8xy6(CPU* cpu, opcode_params* params) {
     // printf("SHR V%d, V%d\n", params->x, params->y);
 
-    // Set Vf to 1 if Vx's least significant bit is 1
-    if (cpu->v[params->x] & 1 == 1) {
-        cpu->v[0xf] = 1;
-    } else {
-        cpu->v[0xf] = 0;
-    }
+    // Set Vf to Vx's least significant bit, the one shifted out
+    uint8_t carry = cpu->v[params->x] & 1;
 
     cpu->v[params->x] /= 2;
+    cpu->v[0xf] = carry;
 }
 
 void opcode_0x8xy7(CPU* cpu, opcode_params* params) {
     // printf("SUBN V%d, V%d\n", params->x, params->y);
 
-    // Set carry bit to 1 if Vx < Vy and 0 otherwise
-    if (cpu->v[params->x] < cpu->v[params->y]) {
-        cpu->v[0xf] = 1;
-    } else {
-        cpu->v[0xf] = 0;
-    }
+    // Set carry bit to 1 if there is no borrow (Vy >= Vx) and 0 otherwise
+    uint8_t carry = cpu->v[params->y] >= cpu->v[params->x];
 
     cpu->v[params->x] = cpu->v[params->y] - cpu->v[params->x];
+    cpu->v[0xf] = carry;
 }
 
 void opcode_0x8xye(CPU* cpu, opcode_params* params) {
     // printf("SHL V%d, V%d\n", params->x, params->y);
 
-    // Set Vf to 1 if Vx's least significant bit is 1
-    if (cpu->v[params->x] >> 7 == 1) {
-        cpu->v[0xf] = 1;
-    } else {
-        cpu->v[0xf] = 0;
-    }
+    // Set Vf to Vx's most significant bit, the one shifted out
+    uint8_t carry = cpu->v[params->x] >> 7;
 
     cpu->v[params->x] *= 2;
+    cpu->v[0xf] = carry;
 }
 
-// Clear the game screen
+// Clear the game screen (only the selected bitplanes on XO-CHIP)
 void opcode_0x00e0(chip* c) {
     // printf("CLS\n");
-    memset(c->game_screen, 0, SCREEN_HEIGHT * SCREEN_WIDTH);
+    for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (c->planes & (1 << plane)) {
+            memset(c->game_screen[plane], 0, sizeof(c->game_screen[plane]));
+        }
+    }
+}
+
+// 00Cn - SCD n
+// Scroll the display down by n pixels. Rows move as whole words, so this is a single memmove per plane.
+void opcode_0x00cn(chip* c, opcode_params* params) {
+    // printf("SCD %d\n", params->kk & 0xf);
+    int n = params->kk & 0x000f;
+    int height = screen_height(c);
+
+    for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (c->planes & (1 << plane)) {
+            uint64_t (*rows)[SCREEN_WORDS] = c->game_screen[plane];
+            memmove(rows[n], rows[0], (height - n) * sizeof(rows[0]));
+            memset(rows[0], 0, n * sizeof(rows[0]));
+        }
+    }
+}
+
+// 00Dn - SCU n (XO-CHIP)
+// Scroll the display up by n pixels.
+void opcode_0x00dn(chip* c, opcode_params* params) {
+    // printf("SCU %d\n", params->kk & 0xf);
+    int n = params->kk & 0x000f;
+    int height = screen_height(c);
+
+    for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (c->planes & (1 << plane)) {
+            uint64_t (*rows)[SCREEN_WORDS] = c->game_screen[plane];
+            memmove(rows[0], rows[n], (height - n) * sizeof(rows[0]));
+            memset(rows[height - n], 0, n * sizeof(rows[0]));
+        }
+    }
+}
+
+// 00FB - SCR
+// Scroll the display right by 4 pixels.
+void opcode_0x00fb(chip* c) {
+    // printf("SCR\n");
+    int height = screen_height(c);
+
+    for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (c->planes & (1 << plane)) {
+            for (int y = 0; y < height; y++) {
+                uint64_t* row = c->game_screen[plane][y];
+                if (c->hires) {
+                    row[1] = (row[1] >> 4) | (row[0] << 60);
+                }
+                row[0] >>= 4;
+            }
+        }
+    }
+}
+
+// 00FC - SCL
+// Scroll the display left by 4 pixels.
+void opcode_0x00fc(chip* c) {
+    // printf("SCL\n");
+    int height = screen_height(c);
+
+    for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (c->planes & (1 << plane)) {
+            for (int y = 0; y < height; y++) {
+                uint64_t* row = c->game_screen[plane][y];
+                row[0] <<= 4;
+                if (c->hires) {
+                    row[0] |= row[1] >> 60;
+                    row[1] <<= 4;
+                }
+            }
+        }
+    }
+}
+
+// 00FD - EXIT
+// Exit the interpreter.
+void opcode_0x00fd(chip* c) {
+    // printf("EXIT\n");
+    c->halted = 1;
+}
+
+// 00FE - LOW
+// Switch to 64x32 low resolution mode and clear the screen.
+void opcode_0x00fe(chip* c) {
+    // printf("LOW\n");
+    c->hires = 0;
+    memset(c->game_screen, 0, sizeof(c->game_screen));
+}
+
+// 00FF - HIGH
+// Switch to 128x64 high resolution mode and clear the screen.
+void opcode_0x00ff(chip* c) {
+    // printf("HIGH\n");
+    c->hires = 1;
+    memset(c->game_screen, 0, sizeof(c->game_screen));
 }
 
 // Return from subroutine:
 // The interpreter sets the program counter to the address at the top of the stack, then subtracts 1 from the stack pointer.
 void opcode_0x00ee(chip* c, CPU* cpu) {
     // printf("  RET %x\n", c->stack[cpu->sp]);
+
+    // sp counts the calls in progress; slot 0 is never used. It can only be
+    // out of range here if the debugger or a snapshot put it there.
+    if (cpu->sp == 0 || cpu->sp >= STACK_SIZE) {
+        raise_fault(c, cpu, cpu->sp == 0 ? FAULT_STACK_UNDERFLOW : FAULT_STACK_OVERFLOW);
+        return;
+    }
+
     cpu->pc = c->stack[cpu->sp];
     cpu->sp--;
 }
@@ -461,6 +595,11 @@ void opcode_0x1000(CPU* cpu, opcode_params* params) {
 void opcode_0x2000(chip* c, CPU* cpu, opcode_params* params) {
     // printf("CALL %x\n", (params->x << 8) | params->kk);
 
+    if (cpu->sp >= STACK_SIZE - 1) {
+        raise_fault(c, cpu, FAULT_STACK_OVERFLOW);
+        return;
+    }
+
     // Push current program counter onto stack and jump to
     // specified address.
     cpu->sp++;
@@ -469,30 +608,60 @@ void opcode_0x2000(chip* c, CPU* cpu, opcode_params* params) {
     cpu->pc = (uint16_t) ((params->x << 8) | params->kk);
 }
 
-void opcode_0x3000(CPU* cpu, opcode_params* params) {
+void opcode_0x3000(chip* c, CPU* cpu, opcode_params* params) {
     // printf("SE V%d, %d\n", params->x, params->kk);
 
     // Compares V-register x with kk and increments the PC if the two values are equal
     if (cpu->v[params->x] == params->kk) {
-        cpu->pc += 2;
+        skip_next(c, cpu);
     }
 }
 
-void opcode_0x4000(CPU* cpu, opcode_params* params) {
+void opcode_0x4000(chip* c, CPU* cpu, opcode_params* params) {
     // printf("SNE V%d, %d\n", params->x, params->kk);
 
     // Compares V-register x with kk and increments the PC if the two values are unequal
     if (cpu->v[params->x] != params->kk) {
-        cpu->pc += 2;
+        skip_next(c, cpu);
     }
 }
 
-void opcode_0x5000(CPU* cpu, opcode_params* params) {
+void opcode_0x5000(chip* c, CPU* cpu, opcode_params* params) {
     // printf("SE V%d, V%d\n", params->x, params->y);
 
     // Compares V-register x with V-register y with kk and increments the PC if equal
     if (cpu->v[params->x] == cpu->v[params->y]) {
-        cpu->pc += 2;
+        skip_next(c, cpu);
+    }
+}
+
+// 5xy2 - SAVE Vx - Vy (XO-CHIP)
+// Store registers Vx through Vy in memory starting at location I, in either order. I is not changed.
+void opcode_0x5xy2(chip* c, CPU* cpu, opcode_params* params) {
+    // printf("SAVE V%d - V%d\n", params->x, params->y);
+    int step = params->x <= params->y ? 1 : -1;
+    uint16_t address = cpu->address;
+
+    for (int i = params->x; ; i += step) {
+        c->mem[address++] = cpu->v[i];
+        if (i == params->y) {
+            break;
+        }
+    }
+}
+
+// 5xy3 - LOAD Vx - Vy (XO-CHIP)
+// Read registers Vx through Vy from memory starting at location I, in either order. I is not changed.
+void opcode_0x5xy3(chip* c, CPU* cpu, opcode_params* params) {
+    // printf("LOAD V%d - V%d\n", params->x, params->y);
+    int step = params->x <= params->y ? 1 : -1;
+    uint16_t address = cpu->address;
+
+    for (int i = params->x; ; i += step) {
+        cpu->v[i] = c->mem[address++];
+        if (i == params->y) {
+            break;
+        }
     }
 }
 
@@ -506,10 +675,10 @@ void opcode_0x7000(CPU* cpu, opcode_params* params) {
     cpu->v[params->x] += params->kk;
 }
 
-void opcode_0x9000(CPU* cpu, opcode_params* params) {
+void opcode_0x9000(chip* c, CPU* cpu, opcode_params* params) {
     // printf("SNE V%d, V%d\n", params->x, params->y);
     if (cpu->v[params->x] != cpu->v[params->y]) {
-        cpu->pc += 2;
+        skip_next(c, cpu);
     }
 }
 
@@ -520,60 +689,119 @@ void opcode_0xa000(CPU* cpu, opcode_params* params) {
 
 void opcode_0xb000(CPU* cpu, opcode_params* params) {
     // printf("JP V0, %d\n", (params->x << 8) | params->kk);
-    cpu->pc = cpu->v[0] + (params->x << 8) | params->kk;
+    cpu->pc = cpu->v[0] + ((params->x << 8) | params->kk);
+}
+
+// Bxnn - JP Vx, xnn (SUPER-CHIP)
+// Jump to location xnn plus Vx.
+void opcode_0xbxnn(CPU* cpu, opcode_params* params) {
+    // printf("JP V%d, %x\n", params->x, (params->x << 8) | params->kk);
+    cpu->pc = cpu->v[params->x] + ((params->x << 8) | params->kk);
 }
 
 void opcode_0xc000(CPU* cpu, opcode_params* params) {
     // printf("RND V%d, %d\n", params->x, params->kk);
-    cpu->v[params->x] = (rand() % 255) & params->kk;
+    // xorshift32
+    uint32_t x = cpu->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    cpu->rng = x;
+
+    cpu->v[params->x] = (x >> 24) & params->kk;
 }
 
-// Draw a sprite on the screen
+// Draw a sprite on the screen. Sprites are 8 pixels wide and n rows tall, or
+// 16x16 when n is 0 outside of plain CHIP-8 mode. The starting position wraps
+// around the screen and the sprite itself is clipped at the edges.
 void opcode_0xd000(chip* c, CPU* cpu, opcode_params* params) {
+    draw_sprite(c, cpu, params, 0);
+}
+
+// Dxyn with the sprite either clipped at the edges or, with wrap set, wrapped
+// around to the opposite edge like its starting position.
+ALWAYS_INLINE void draw_sprite(chip* c, CPU* cpu, opcode_params* params, int wrap) {
     // printf("DRW V%d, V%d, %d\n", params->x, params->y, params->kk & 0x000f);
 
-    // Set 0xF-th V register to 0
-    cpu->v[0xf] = 0;
+    int width = screen_width(c);
+    int height = screen_height(c);
+    int x = cpu->v[params->x] & (width - 1);
+    int y = cpu->v[params->y] & (height - 1);
 
-    // Number of bytes to read
+    // Number of rows to draw, and pixels per row
     int n = params->kk & 0x000f;
+    int sprite_width = 8;
+    if (n == 0 && c->mode != MODE_CHIP8) {
+        n = 16;
+        sprite_width = 16;
+    }
 
-    // Loop for the different vertical lines to draw
-    for (int yline = 0; yline < n; yline++) {
-        // Each sprite is 8 pixels wide
-        uint8_t data = c->mem[cpu->address + yline];
-
-        // Iterate over each pixel. Note that the ith pixel is the (7-i)th bit
-        // for sprite data.
-        for (int xpixel = 0; xpixel < 8; xpixel++) {
-            uint8_t mask = 1 << (7 - xpixel);
-            if (data & mask) {
-                uint8_t x = cpu->v[params->x] + xpixel;
-                uint8_t y = cpu->v[params->y] + yline;
-
-                // Count collisions (i.e. drawing over a screen pixel that is already on)
-                if (c->game_screen[y][x] == 1) {
-                    cpu->v[0xf] = 1;
-                }
+    // Each plane's sprite data follows the previous plane's
+    uint16_t address = cpu->address;
+    int collisions = 0;
+
+    for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (!(c->planes & (1 << plane))) {
+            continue;
+        }
+
+        for (int yline = 0; yline < n; yline++) {
+            uint16_t data = c->mem[address++];
+            if (sprite_width == 16) {
+                data = data << 8 | c->mem[address++];
+            }
+
+            // Rows past the bottom edge are clipped
+            if (y + yline >= height && !wrap) {
+                continue;
+            }
+
+            // Line the sprite row up with the two words of the screen row.
+            // Whatever lands in the second word is clipped in low resolution.
+            uint64_t bits = (uint64_t) data << (64 - sprite_width);
+            uint64_t left = x < 64 ? bits >> x : 0;
+            uint64_t right = x < 64 ? (x > 0 ? bits << (64 - x) : 0) : bits >> (x - 64);
+            if (!c->hires) {
+                right = 0;
+            }
 
-                // XOR game screen and data
-                c->game_screen[y][x] ^= 1;
+            // Pixels past the right edge come back in on the left, which is
+            // always within the first word
+            if (wrap && x + sprite_width > width) {
+                left |= bits << (width - x);
             }
+
+            uint64_t* row = c->game_screen[plane][(y + yline) & (height - 1)];
+
+            // Count collisions (i.e. drawing over a screen pixel that is already on)
+            if ((row[0] & left) | (row[1] & right)) {
+                collisions++;
+            }
+
+            // XOR game screen and data
+            row[0] ^= left;
+            row[1] ^= right;
         }
     }
+
+    // SUPER-CHIP reports the number of colliding rows in high resolution
+    if (c->mode == MODE_SCHIP && c->hires) {
+        cpu->v[0xf] = collisions;
+    } else {
+        cpu->v[0xf] = collisions > 0;
+    }
 }
 
 // Ex9E - SKP Vx
 // Skip next instruction if key with the value of Vx is pressed.
 
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
-void opcode_0xex9e(CPU* cpu, opcode_params* params) {
+void opcode_0xex9e(chip* c, CPU* cpu, opcode_params* params) {
     // printf("SKP V%d\n", params->x);
 
-    // Check keyboard
-    const uint8_t *state = SDL_GetKeyboardState(NULL);
-    if (state[val_to_key(cpu->v[params->x])]) {
-        cpu->pc += 2;
+    // Check keypad
+    if (c->keys >> (cpu->v[params->x] & 0xF) & 1) {
+        skip_next(c, cpu);
     }
 }
 
@@ -582,13 +810,12 @@ void opcode_0xex9e(CPU* cpu, opcode_params* params) {
 // Skip next instruction if key with the value of Vx is not pressed.
 
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
-void opcode_0xexa1(CPU* cpu, opcode_params* params) {
+void opcode_0xexa1(chip* c, CPU* cpu, opcode_params* params) {
     // printf("SKNP V%d\n", params->x);
 
-    // Check keyboard
-    const uint8_t *state = SDL_GetKeyboardState(NULL);
-    if (!state[val_to_key(cpu->v[params->x])]) {
-        cpu->pc += 2;
+    // Check keypad
+    if (!(c->keys >> (cpu->v[params->x] & 0xF) & 1)) {
+        skip_next(c, cpu);
     }
 }
 
@@ -606,13 +833,26 @@ void opcode_0xfx07(CPU* cpu, opcode_params* params) {
 // Wait for a key press, store the value of the key in Vx.
 
 // All execution stops until a key is pressed, then the value of that key is stored in Vx.
-void opcode_0xfx0a(CPU* cpu, opcode_params* params) {
+// Like the COSMAC VIP, the key is only accepted once it is released again. The
+// instruction repeats itself while waiting so the frontend keeps running.
+void opcode_0xfx0a(chip* c, CPU* cpu, opcode_params* params) {
     // printf("LD V%d, K\n", params->x);
 
-    SDL_Event event;
-    while (SDL_WaitEvent(&event) && event.key.state == SDL_PRESSED) {
-        cpu->v[params->x] = key_to_v_register(event.key);
+    if (c->key_pressed == 0) {
+        // Wait for the lowest numbered key to go down
+        for (int i = 0; i < 16; i++) {
+            if (c->keys & (1 << i)) {
+                c->key_pressed = i + 1;
+                break;
+            }
+        }
+    } else if (!(c->keys & (1 << (c->key_pressed - 1)))) {
+        cpu->v[params->x] = c->key_pressed - 1;
+        c->key_pressed = 0;
+        return;
     }
+
+    cpu->pc -= 2;
 }
 
 // Fx15 - LD DT, Vx
@@ -649,10 +889,18 @@ void opcode_0xfx1e(CPU* cpu, opcode_params* params) {
 // Set I = location of sprite for digit Vx.
 
 // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx. See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
-void opcode_0xfx29(chip* c, CPU* cpu, opcode_params* params) {
+void opcode_0xfx29(CPU* cpu, opcode_params* params) {
     // printf("LD F, V%d\n", params->x);
 
-    cpu->address = c->mem[cpu->v[params->x] * 5];
+    cpu->address = FONT_START + (cpu->v[params->x] & 0xF) * 5;
+}
+
+// Fx30 - LD HF, Vx (SUPER-CHIP)
+// Set I = location of the 10-byte high resolution sprite for digit Vx.
+void opcode_0xfx30(CPU* cpu, opcode_params* params) {
+    // printf("LD HF, V%d\n", params->x);
+
+    cpu->address = BIG_FONT_START + (cpu->v[params->x] & 0xF) * 10;
 }
 
 // Fx33 - LD B, Vx
@@ -662,9 +910,10 @@ void opcode_0xfx29(chip* c, CPU* cpu, opcode_params* params) {
 void opcode_0xfx33(chip* c, CPU* cpu, opcode_params* params) {
     // printf("LD B, V%d\n", params->x);
 
+    // Addresses wrap around the end of memory like everywhere else
     c->mem[cpu->address] = (cpu->v[params->x] / 100) % 10;
-    c->mem[cpu->address + 1] = (cpu->v[params->x] / 10) % 10;
-    c->mem[cpu->address + 2] = cpu->v[params->x]% 10;
+    c->mem[(uint16_t)(cpu->address + 1)] = (cpu->v[params->x] / 10) % 10;
+    c->mem[(uint16_t)(cpu->address + 2)] = cpu->v[params->x]% 10;
 }
 
 // Fx55 - STRR Vx
@@ -675,7 +924,7 @@ void opcode_0xfx55(chip* c, CPU* cpu, opcode_params* params) {
     // printf("STRR, V%d\n", params->x);
 
     for (int i = 0; i <= params->x; i++) {
-        c->mem[cpu->address + i] = cpu->v[i];
+        c->mem[(uint16_t)(cpu->address + i)] = cpu->v[i];
     }
 }
 
@@ -687,6 +936,60 @@ void opcode_0xfx65(chip* c, CPU* cpu, opcode_params* params) {
     // printf("STRI, V%d\n", params->x);
 
     for (int i = 0; i <= params->x; i++) {
-        cpu->v[i] = c->mem[cpu->address + i];
+        cpu->v[i] = c->mem[(uint16_t)(cpu->address + i)];
+    }
+}
+
+// Fx75 - LD R, Vx (SUPER-CHIP)
+// Store V0 through Vx in the RPL user flags.
+void opcode_0xfx75(chip* c, CPU* cpu, opcode_params* params) {
+    // printf("LD R, V%d\n", params->x);
+
+    for (int i = 0; i <= params->x; i++) {
+        c->rpl[i] = cpu->v[i];
+    }
+}
+
+// Fx85 - LD Vx, R (SUPER-CHIP)
+// Read V0 through Vx from the RPL user flags.
+void opcode_0xfx85(chip* c, CPU* cpu, opcode_params* params) {
+    // printf("LD V%d, R\n", params->x);
+
+    for (int i = 0; i <= params->x; i++) {
+        cpu->v[i] = c->rpl[i];
     }
+}
+
+// F000 nnnn - LD I, nnnn (XO-CHIP)
+// Set I to the 16-bit address stored in the following instruction word.
+void opcode_0xf000(chip* c, CPU* cpu) {
+    cpu->address = (uint16_t)(c->mem[cpu->pc] << 8 | c->mem[(uint16_t)(cpu->pc + 1)]);
+    // printf("LD I, %x\n", cpu->address);
+    cpu->pc += 2;
+}
+
+// Fn01 - PLANE n (XO-CHIP)
+// Select the bitplanes that drawing, clearing and scrolling operate on.
+void opcode_0xfn01(chip* c, opcode_params* params) {
+    // printf("PLANE %d\n", params->x);
+
+    c->planes = params->x & 3;
+}
+
+// F002 - AUDIO (XO-CHIP)
+// Load the 16-byte audio pattern buffer from memory starting at I.
+void opcode_0xf002(chip* c, CPU* cpu) {
+    // printf("AUDIO\n");
+
+    for (int i = 0; i < 16; i++) {
+        c->audio[i] = c->mem[(uint16_t)(cpu->address + i)];
+    }
+}
+
+// Fx3A - PITCH Vx (XO-CHIP)
+// Set the audio playback pitch register to Vx.
+void opcode_0xfx3a(chip* c, CPU* cpu, opcode_params* params) {
+    // printf("PITCH V%d\n", params->x);
+
+    c->pitch = cpu->v[params->x];
 }
\ No newline at end of file
@@ -1,13 +1,14 @@
 #include <inttypes.h>
-#include <SDL.h>
 #include "mem.h"
-#include "instructions.h"
 
 // CPU clock speed in hertz
 #define CPU_CLOCK_SPEED 1000
 #define TIMER_CLOCK_SPEED 60
 #define FRAMES_PER_SECOND 60
 
+// Initial random number state of every CPU (must be non-zero)
+#define CPU_RNG_SEED 0x2545F491
+
 typedef struct CPU {
     // 8-bit V registers (V0 to VF)
     uint8_t v[16];
@@ -26,6 +27,9 @@ typedef struct CPU {
 
     // Sound timer
     uint8_t st;
+
+    // Random number state for Cxkk, kept per instance so that runs are reproducible
+    uint32_t rng;
 } CPU;
 
 typedef struct opcode_params {
@@ -39,25 +43,60 @@ typedef struct opcode_params {
     uint8_t kk;
 } opcode_params;
 
-CPU* initialize();
+// Behaviour that differs between CHIP-8 implementations. Each flag picks
+// the alternative to the modern behaviour.
+typedef struct quirks {
+    // 8xy6/8xyE shift Vy into Vx instead of shifting Vx in place (COSMAC VIP)
+    uint8_t shift_vy;
+
+    // Fx55/Fx65 leave I pointing past the last register (COSMAC VIP)
+    uint8_t increment_i;
+
+    // Bnnn becomes Bxnn, jumping to xnn + Vx instead of nnn + V0 (SUPER-CHIP)
+    uint8_t jump_vx;
 
-void run(chip* c, CPU* cpu);
+    // Dxyn wraps sprites around the screen edges instead of clipping them
+    uint8_t wrap_sprites;
+
+    // 8xy1/8xy2/8xy3 reset VF (COSMAC VIP)
+    uint8_t vf_reset;
+} quirks;
+
+// Indexed by QUIRKS_*
+extern const quirks quirk_profiles[QUIRK_PROFILES];
+
+CPU* initialize();
 
 uint16_t cycle(chip* c, CPU *cpu);
+uint16_t cycle_generic(chip* c, CPU* cpu);
 
 uint16_t execute(chip* c, CPU* cpu, uint16_t data);
 
 struct opcode_params* decode_params(uint16_t data);
 
-void putpixel(SDL_Surface *surface, int x, int y, Uint32 pixel);
+int stored_bytes(uint16_t data);
+const char* fault_name(int fault);
+
+// Display helpers
+int screen_width(chip* c);
+int screen_height(chip* c);
 
 void opcode_0x00e0(chip* c);
 void opcode_0x00ee(chip* c, CPU* cpu);
+void opcode_0x00cn(chip* c, opcode_params* params);
+void opcode_0x00dn(chip* c, opcode_params* params);
+void opcode_0x00fb(chip* c);
+void opcode_0x00fc(chip* c);
+void opcode_0x00fd(chip* c);
+void opcode_0x00fe(chip* c);
+void opcode_0x00ff(chip* c);
 void opcode_0x1000(CPU* cpu, opcode_params* params);
 void opcode_0x2000(chip* c, CPU* cpu, opcode_params* params);
-void opcode_0x3000(CPU* cpu, opcode_params* params);
-void opcode_0x4000(CPU* cpu, opcode_params* params);
-void opcode_0x5000(CPU* cpu, opcode_params* params);
+void opcode_0x3000(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0x4000(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0x5000(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0x5xy2(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0x5xy3(chip* c, CPU* cpu, opcode_params* params);
 void opcode_0x6000(CPU* cpu, opcode_params* params);
 void opcode_0x7000(CPU* cpu, opcode_params* params);
 void opcode_0x8xy0(CPU* cpu, opcode_params* params);
@@ -69,20 +108,28 @@ void opcode_0x8xy5(CPU* cpu, opcode_params* params);
 void opcode_0x8xy6(CPU* cpu, opcode_params* params);
 void opcode_0x8xy7(CPU* cpu, opcode_params* params);
 void opcode_0x8xye(CPU* cpu, opcode_params* params);
-void opcode_0x9000(CPU* cpu, opcode_params* params);
+void opcode_0x9000(chip* c, CPU* cpu, opcode_params* params);
 void opcode_0xa000(CPU* cpu, opcode_params* params);
 void opcode_0xb000(CPU* cpu, opcode_params* params);
+void opcode_0xbxnn(CPU* cpu, opcode_params* params);
 void opcode_0xc000(CPU* cpu, opcode_params* params);
 void opcode_0xd000(chip* c, CPU* cpu, opcode_params* params);
-void opcode_0xex9e(CPU* cpu, opcode_params* params);
-void opcode_0xexa1(CPU* cpu, opcode_params* params);
+void opcode_0xex9e(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0xexa1(chip* c, CPU* cpu, opcode_params* params);
 
+void opcode_0xf000(chip* c, CPU* cpu);
+void opcode_0xfn01(chip* c, opcode_params* params);
+void opcode_0xf002(chip* c, CPU* cpu);
 void opcode_0xfx07(CPU* cpu, opcode_params* params);
-void opcode_0xfx0a(CPU* cpu, opcode_params* params);
+void opcode_0xfx0a(chip* c, CPU* cpu, opcode_params* params);
 void opcode_0xfx15(CPU* cpu, opcode_params* params);
 void opcode_0xfx18(CPU* cpu, opcode_params* params);
 void opcode_0xfx1e(CPU* cpu, opcode_params* params);
-void opcode_0xfx29(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0xfx29(CPU* cpu, opcode_params* params);
+void opcode_0xfx30(CPU* cpu, opcode_params* params);
 void opcode_0xfx33(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0xfx3a(chip* c, CPU* cpu, opcode_params* params);
 void opcode_0xfx55(chip* c, CPU* cpu, opcode_params* params);
-void opcode_0xfx65(chip* c, CPU* cpu, opcode_params* params);
\ No newline at end of file
+void opcode_0xfx65(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0xfx75(chip* c, CPU* cpu, opcode_params* params);
+void opcode_0xfx85(chip* c, CPU* cpu, opcode_params* params);
\ No newline at end of file
@@ -0,0 +1,647 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "cpu.h"
+#include "debugger.h"
+#include "trace.h"
+
+// GDB register numbering: V0-VF are 0-15, followed by I, PC, SP, DT and ST.
+// I and PC are 16 bits wide and sent little-endian; everything else is a byte.
+#define GDB_REG_I  16
+#define GDB_REG_PC 17
+#define GDB_REG_SP 18
+#define GDB_REG_DT 19
+#define GDB_REG_ST 20
+#define GDB_NUM_REGS 21
+
+// Creates a debugger with no breakpoints set.
+debugger* debugger_create() {
+    debugger* d = calloc(1, sizeof(debugger));
+    if (d == NULL) {
+        return NULL;
+    }
+
+    d->listen_fd = -1;
+    d->client_fd = -1;
+
+    return d;
+}
+
+void debugger_destroy(debugger* d) {
+    if (d->client_fd >= 0) {
+        close(d->client_fd);
+    }
+    if (d->listen_fd >= 0) {
+        close(d->listen_fd);
+    }
+    free(d);
+}
+
+// Returns whether the slower debug_cycle() has to be used instead of cycle().
+int debugger_active(debugger* d) {
+    return d->num_breakpoints > 0 || d->num_watchpoints > 0 || d->reg_watch != 0 || d->stepping || d->stopped;
+}
+
+void debugger_add_breakpoint(debugger* d, uint16_t address) {
+    uint8_t bit = 1 << (address & 7);
+    if (!(d->breakpoints[address >> 3] & bit)) {
+        d->breakpoints[address >> 3] |= bit;
+        d->num_breakpoints++;
+    }
+}
+
+void debugger_remove_breakpoint(debugger* d, uint16_t address) {
+    uint8_t bit = 1 << (address & 7);
+    if (d->breakpoints[address >> 3] & bit) {
+        d->breakpoints[address >> 3] &= ~bit;
+        d->num_breakpoints--;
+    }
+}
+
+// Adds a write watchpoint. Returns 0 if all watchpoint slots are used.
+int debugger_add_watchpoint(debugger* d, uint16_t address, uint16_t length) {
+    if (d->num_watchpoints == DEBUG_MAX_WATCHPOINTS) {
+        return 0;
+    }
+
+    d->watchpoints[d->num_watchpoints].address = address;
+    d->watchpoints[d->num_watchpoints].length = length;
+    d->num_watchpoints++;
+
+    return 1;
+}
+
+void debugger_remove_watchpoint(debugger* d, uint16_t address, uint16_t length) {
+    for (int i = 0; i < d->num_watchpoints; i++) {
+        if (d->watchpoints[i].address == address && d->watchpoints[i].length == length) {
+            d->watchpoints[i] = d->watchpoints[--d->num_watchpoints];
+            return;
+        }
+    }
+}
+
+// Continues execution, optionally for a single instruction only.
+void debugger_resume(debugger* d, int step) {
+    d->stopped = 0;
+    d->stop_reason = STOP_NONE;
+    d->stepping = step;
+    d->skip_breakpoint = 1;
+}
+
+static void debugger_stop(debugger* d, int reason) {
+    d->stopped = 1;
+    d->stop_reason = reason;
+    d->stepping = 0;
+}
+
+// Returns the mask of WATCH_* bits whose registers differ between a and b.
+static uint32_t changed_registers(CPU* a, CPU* b) {
+    uint32_t changed = 0;
+    for (int i = 0; i < 16; i++) {
+        if (a->v[i] != b->v[i]) {
+            changed |= 1 << i;
+        }
+    }
+    if (a->address != b->address) {
+        changed |= WATCH_I;
+    }
+    if (a->sp != b->sp) {
+        changed |= WATCH_SP;
+    }
+    if (a->dt != b->dt) {
+        changed |= WATCH_DT;
+    }
+    if (a->st != b->st) {
+        changed |= WATCH_ST;
+    }
+
+    return changed;
+}
+
+// Runs a single CPU cycle while checking breakpoints and watchpoints, and
+// records it if d->trace is set. Does nothing while the debugger is
+// stopped. Returns the executed opcode like cycle(), or 0 if nothing was
+// executed.
+uint16_t debug_cycle(debugger* d, chip* c, CPU* cpu) {
+    if (d->stopped) {
+        return 0;
+    }
+
+    // PC breakpoints stop before the instruction executes
+    uint16_t pc = cpu->pc;
+    if (!d->skip_breakpoint && d->breakpoints[pc >> 3] & (1 << (pc & 7))) {
+        debugger_stop(d, STOP_BREAKPOINT);
+        return 0;
+    }
+    d->skip_breakpoint = 0;
+
+    CPU before = *cpu;
+    uint16_t data = (uint16_t)(c->mem[pc] << 8 | c->mem[(uint16_t)(pc + 1)]);
+
+    uint16_t opcode = d->trace != NULL ? trace_cycle(d->trace, c, cpu) : cycle(c, cpu);
+
+    // Memory watchpoints only need checking for the instructions that store
+    // to memory. Stores wrap around the end of memory, so the ranges overlap
+    // when either one starts inside the other, counting modulo 64K.
+    int count = stored_bytes(data);
+    for (int i = 0; i < d->num_watchpoints && count > 0; i++) {
+        watchpoint* w = &d->watchpoints[i];
+        if ((uint16_t)(w->address - before.address) < count || (uint16_t)(before.address - w->address) < w->length) {
+            d->stop_address = w->address;
+            debugger_stop(d, STOP_WATCH_MEM);
+            return opcode;
+        }
+    }
+
+    if (d->reg_watch & changed_registers(&before, cpu)) {
+        debugger_stop(d, STOP_WATCH_REG);
+        return opcode;
+    }
+
+    if (d->stepping) {
+        debugger_stop(d, STOP_STEP);
+    }
+
+    return opcode;
+}
+
+// Waits for a GDB client to connect on the given local TCP port. Execution
+// starts halted, as with gdbserver. Returns 0 on failure.
+int debugger_listen(debugger* d, int port) {
+    d->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (d->listen_fd < 0) {
+        return 0;
+    }
+
+    int yes = 1;
+    setsockopt(d->listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(d->listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(d->listen_fd, 1) != 0) {
+        return 0;
+    }
+
+    printf("Waiting for GDB connection on port %d\n", port);
+    d->client_fd = accept(d->listen_fd, NULL, NULL);
+    if (d->client_fd < 0) {
+        return 0;
+    }
+    setsockopt(d->client_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    d->gdb_in_len = 0;
+    debugger_stop(d, STOP_INTERRUPT);
+
+    return 1;
+}
+
+static int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+// Decodes a byte from two hex digits, or returns -1 if either isn't one.
+static int hex_byte(const char* hex) {
+    int high = hex_value(hex[0]);
+    int low = high < 0 ? -1 : hex_value(hex[1]);
+    return low < 0 ? -1 : high << 4 | low;
+}
+
+// Parses a hex number, advancing the string pointer past it.
+static unsigned long parse_hex(const char** s) {
+    unsigned long value = 0;
+    while (hex_value(**s) >= 0) {
+        value = (value << 4) | hex_value(**s);
+        (*s)++;
+    }
+    return value;
+}
+
+static void put_hex8(char* out, uint8_t value) {
+    static const char digits[] = "0123456789abcdef";
+    out[0] = digits[value >> 4];
+    out[1] = digits[value & 0xF];
+}
+
+static void gdb_send(debugger* d, const char* payload) {
+    char packet[GDB_MAX_PACKET + 4];
+    int len = strlen(payload);
+    uint8_t checksum = 0;
+
+    packet[0] = '$';
+    for (int i = 0; i < len; i++) {
+        packet[i + 1] = payload[i];
+        checksum += (uint8_t) payload[i];
+    }
+    packet[len + 1] = '#';
+    put_hex8(&packet[len + 2], checksum);
+
+    if (write(d->client_fd, packet, len + 4) < 0) {
+        perror("gdb");
+    }
+}
+
+static void gdb_send_stop(debugger* d) {
+    char reply[32];
+
+    switch (d->stop_reason) {
+        case STOP_INTERRUPT:
+            strcpy(reply, "S02");
+            break;
+        case STOP_WATCH_MEM:
+            sprintf(reply, "T05watch:%x;", d->stop_address);
+            break;
+        default:
+            strcpy(reply, "S05");
+    }
+
+    gdb_send(d, reply);
+}
+
+// Returns the value and width in bytes of GDB register n.
+static int gdb_register(CPU* cpu, int n, uint16_t* value) {
+    if (n < 16) {
+        *value = cpu->v[n];
+        return 1;
+    }
+
+    switch (n) {
+        case GDB_REG_I:
+            *value = cpu->address;
+            return 2;
+        case GDB_REG_PC:
+            *value = cpu->pc;
+            return 2;
+        case GDB_REG_SP:
+            *value = cpu->sp;
+            return 1;
+        case GDB_REG_DT:
+            *value = cpu->dt;
+            return 1;
+        case GDB_REG_ST:
+            *value = cpu->st;
+            return 1;
+    }
+
+    return 0;
+}
+
+static void gdb_set_register(CPU* cpu, int n, uint16_t value) {
+    if (n < 16) {
+        cpu->v[n] = value;
+        return;
+    }
+
+    switch (n) {
+        case GDB_REG_I:
+            cpu->address = value;
+            break;
+        case GDB_REG_PC:
+            cpu->pc = value;
+            break;
+        case GDB_REG_SP:
+            cpu->sp = value;
+            break;
+        case GDB_REG_DT:
+            cpu->dt = value;
+            break;
+        case GDB_REG_ST:
+            cpu->st = value;
+            break;
+    }
+}
+
+// Encodes register n into out, returning the number of characters written.
+static int gdb_encode_register(CPU* cpu, int n, char* out) {
+    uint16_t value;
+    int width = gdb_register(cpu, n, &value);
+    for (int i = 0; i < width; i++) {
+        put_hex8(&out[i * 2], (value >> (i * 8)) & 0xFF);
+    }
+    return width * 2;
+}
+
+// Decodes register n from hex, returning the number of characters consumed.
+static int gdb_decode_register(CPU* cpu, int n, const char* in) {
+    uint16_t value;
+    int width = gdb_register(cpu, n, &value);
+
+    value = 0;
+    for (int i = 0; i < width; i++) {
+        if (hex_value(in[i * 2]) < 0 || hex_value(in[i * 2 + 1]) < 0) {
+            return 0;
+        }
+        value |= (hex_value(in[i * 2]) << 4 | hex_value(in[i * 2 + 1])) << (i * 8);
+    }
+    gdb_set_register(cpu, n, value);
+
+    return width * 2;
+}
+
+// Handles "monitor" commands used for register watchpoints:
+// "watch <reg>" and "unwatch <reg>", where reg is v0-vf, i, sp, dt or st.
+static void gdb_monitor(debugger* d, const char* hex) {
+    char cmd[128];
+    int len = 0;
+    while (hex[0] && len < (int) sizeof(cmd) - 1) {
+        int byte = hex_byte(hex);
+        if (byte < 0) {
+            gdb_send(d, "E01");
+            return;
+        }
+        cmd[len++] = byte;
+        hex += 2;
+    }
+    cmd[len] = '\0';
+
+    char action[16], reg[8];
+    if (sscanf(cmd, "%15s %7s", action, reg) != 2) {
+        gdb_send(d, "E01");
+        return;
+    }
+
+    uint32_t bit = 0;
+    if ((reg[0] == 'v' || reg[0] == 'V') && hex_value(reg[1]) >= 0 && reg[2] == '\0') {
+        bit = 1 << hex_value(reg[1]);
+    } else if (strcmp(reg, "i") == 0) {
+        bit = WATCH_I;
+    } else if (strcmp(reg, "sp") == 0) {
+        bit = WATCH_SP;
+    } else if (strcmp(reg, "dt") == 0) {
+        bit = WATCH_DT;
+    } else if (strcmp(reg, "st") == 0) {
+        bit = WATCH_ST;
+    }
+
+    if (bit == 0) {
+        gdb_send(d, "E01");
+    } else if (strcmp(action, "watch") == 0) {
+        d->reg_watch |= bit;
+        gdb_send(d, "OK");
+    } else if (strcmp(action, "unwatch") == 0) {
+        d->reg_watch &= ~bit;
+        gdb_send(d, "OK");
+    } else {
+        gdb_send(d, "E01");
+    }
+}
+
+// Handles a single packet from the client.
+static void gdb_handle(debugger* d, chip* c, CPU* cpu, const char* packet) {
+    char reply[GDB_MAX_PACKET];
+    const char* p = packet + 1;
+
+    switch (packet[0]) {
+        case '?':
+            gdb_send_stop(d);
+            break;
+
+        case 'g': {
+            int len = 0;
+            for (int n = 0; n < GDB_NUM_REGS; n++) {
+                len += gdb_encode_register(cpu, n, &reply[len]);
+            }
+            reply[len] = '\0';
+            gdb_send(d, reply);
+            break;
+        }
+
+        case 'G':
+            for (int n = 0; n < GDB_NUM_REGS && *p; n++) {
+                p += gdb_decode_register(cpu, n, p);
+            }
+            gdb_send(d, "OK");
+            break;
+
+        case 'p': {
+            int n = parse_hex(&p);
+            if (n >= GDB_NUM_REGS) {
+                gdb_send(d, "E01");
+                break;
+            }
+            reply[gdb_encode_register(cpu, n, reply)] = '\0';
+            gdb_send(d, reply);
+            break;
+        }
+
+        case 'P': {
+            int n = parse_hex(&p);
+            if (n >= GDB_NUM_REGS || *p != '=' || !gdb_decode_register(cpu, n, p + 1)) {
+                gdb_send(d, "E01");
+                break;
+            }
+            gdb_send(d, "OK");
+            break;
+        }
+
+        case 'm': {
+            unsigned long address = parse_hex(&p);
+            unsigned long length = *p == ',' ? (p++, parse_hex(&p)) : 0;
+            if (address + length > EMU_MEMORY || length * 2 >= sizeof(reply)) {
+                gdb_send(d, "E01");
+                break;
+            }
+            for (unsigned long i = 0; i < length; i++) {
+                put_hex8(&reply[i * 2], c->mem[address + i]);
+            }
+            reply[length * 2] = '\0';
+            gdb_send(d, reply);
+            break;
+        }
+
+        case 'M': {
+            unsigned long address = parse_hex(&p);
+            unsigned long length = *p == ',' ? (p++, parse_hex(&p)) : 0;
+            if (*p != ':' || address + length > EMU_MEMORY || strlen(p + 1) < length * 2) {
+                gdb_send(d, "E01");
+                break;
+            }
+            p++;
+
+            // Check every digit first, so a bad packet writes nothing
+            unsigned long checked = 0;
+            while (checked < length && hex_byte(p + checked * 2) >= 0) {
+                checked++;
+            }
+            if (checked < length) {
+                gdb_send(d, "E01");
+                break;
+            }
+            for (unsigned long i = 0; i < length; i++) {
+                c->mem[address + i] = hex_byte(p + i * 2);
+            }
+            gdb_send(d, "OK");
+            break;
+        }
+
+        case 'c':
+        case 's':
+            if (*p) {
+                cpu->pc = parse_hex(&p);
+            }
+            debugger_resume(d, packet[0] == 's');
+            break;
+
+        case 'Z':
+        case 'z': {
+            int type = parse_hex(&p);
+            unsigned long address = *p == ',' ? (p++, parse_hex(&p)) : 0;
+            unsigned long length = *p == ',' ? (p++, parse_hex(&p)) : 1;
+
+            if (type == 0 || type == 1) {
+                if (packet[0] == 'Z') {
+                    debugger_add_breakpoint(d, address);
+                } else {
+                    debugger_remove_breakpoint(d, address);
+                }
+                gdb_send(d, "OK");
+            } else if (type == 2) {
+                if (packet[0] == 'z') {
+                    debugger_remove_watchpoint(d, address, length);
+                    gdb_send(d, "OK");
+                } else {
+                    gdb_send(d, debugger_add_watchpoint(d, address, length) ? "OK" : "E01");
+                }
+            } else {
+                gdb_send(d, "");
+            }
+            break;
+        }
+
+        case 'D':
+        case 'k':
+            // Clear all debugging state and let the ROM run freely
+            memset(d->breakpoints, 0, sizeof(d->breakpoints));
+            d->num_breakpoints = 0;
+            d->num_watchpoints = 0;
+            d->reg_watch = 0;
+            debugger_resume(d, 0);
+            if (packet[0] == 'D') {
+                gdb_send(d, "OK");
+            }
+            close(d->client_fd);
+            d->client_fd = -1;
+            break;
+
+        case 'q':
+            if (strncmp(packet, "qSupported", 10) == 0) {
+                sprintf(reply, "PacketSize=%x", GDB_MAX_PACKET);
+                gdb_send(d, reply);
+            } else if (strcmp(packet, "qAttached") == 0) {
+                gdb_send(d, "1");
+            } else if (strncmp(packet, "qRcmd,", 6) == 0) {
+                gdb_monitor(d, packet + 6);
+            } else {
+                gdb_send(d, "");
+            }
+            break;
+
+        default:
+            gdb_send(d, "");
+    }
+}
+
+// Services the GDB connection, waiting up to timeout_ms for input (-1 waits
+// forever). Reports a pending stop to the client first. Returns 0 once no
+// client is connected.
+int debugger_poll(debugger* d, chip* c, CPU* cpu, int timeout_ms) {
+    if (d->client_fd < 0) {
+        return 0;
+    }
+
+    if (!d->stopped) {
+        d->stop_reported = 0;
+    } else if (!d->stop_reported) {
+        gdb_send_stop(d);
+        d->stop_reported = 1;
+    }
+
+    struct pollfd pfd = {d->client_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return 1;
+    }
+
+    int n = read(d->client_fd, d->gdb_in + d->gdb_in_len, sizeof(d->gdb_in) - d->gdb_in_len - 1);
+    if (n <= 0) {
+        close(d->client_fd);
+        d->client_fd = -1;
+        debugger_resume(d, 0);
+        return 0;
+    }
+    d->gdb_in_len += n;
+    d->gdb_in[d->gdb_in_len] = '\0';
+
+    // Process every complete packet in the buffer
+    int pos = 0;
+    while (pos < d->gdb_in_len && d->client_fd >= 0) {
+        char ch = d->gdb_in[pos];
+
+        if (ch == 0x03) {
+            // Interrupt request
+            if (!d->stopped) {
+                debugger_stop(d, STOP_INTERRUPT);
+                gdb_send_stop(d);
+                d->stop_reported = 1;
+            }
+            pos++;
+            continue;
+        }
+        if (ch != '$') {
+            // Acks and line noise
+            pos++;
+            continue;
+        }
+
+        char* end = memchr(d->gdb_in + pos, '#', d->gdb_in_len - pos);
+        if (end == NULL || end + 2 >= d->gdb_in + d->gdb_in_len) {
+            break;
+        }
+
+        *end = '\0';
+        if (write(d->client_fd, "+", 1) < 0) {
+            perror("gdb");
+        }
+
+        int was_stopped = d->stopped;
+        gdb_handle(d, c, cpu, d->gdb_in + pos + 1);
+        if (was_stopped && !d->stopped) {
+            d->stop_reported = 0;
+        }
+
+        pos = end + 3 - d->gdb_in;
+    }
+
+    memmove(d->gdb_in, d->gdb_in + pos, d->gdb_in_len - pos);
+    d->gdb_in_len -= pos;
+
+    // A packet that fills the buffer without ending is longer than the
+    // PacketSize we offered. Reject it and drop what we have; the rest of it
+    // holds no '$', so it is skipped as noise when it arrives.
+    if (d->gdb_in_len == (int) sizeof(d->gdb_in) - 1 && d->client_fd >= 0) {
+        if (write(d->client_fd, "+", 1) < 0) {
+            perror("gdb");
+        }
+        gdb_send(d, "E01");
+        d->gdb_in_len = 0;
+    }
+
+    return d->client_fd >= 0;
+}
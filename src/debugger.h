@@ -0,0 +1,86 @@
+#include <inttypes.h>
+
+// Largest GDB packet we accept or send
+#define GDB_MAX_PACKET 4096
+
+// Limits on the number of simultaneous memory watchpoints
+#define DEBUG_MAX_WATCHPOINTS 16
+
+// Register watch bits. Bits 0-15 are V0 to VF.
+#define WATCH_I  (1 << 16)
+#define WATCH_SP (1 << 17)
+#define WATCH_DT (1 << 18)
+#define WATCH_ST (1 << 19)
+
+// Reasons for the debugger halting execution
+#define STOP_NONE       0
+#define STOP_BREAKPOINT 1
+#define STOP_WATCH_MEM  2
+#define STOP_WATCH_REG  3
+#define STOP_STEP       4
+#define STOP_INTERRUPT  5
+
+struct chip;
+struct CPU;
+struct trace;
+
+typedef struct watchpoint {
+    uint16_t address;
+    uint16_t length;
+} watchpoint;
+
+typedef struct debugger {
+    // One bit per memory address
+    uint8_t breakpoints[(1 << 16) / 8];
+    int num_breakpoints;
+
+    // Write watchpoints on memory stored by Fx33/Fx55/5xy2
+    watchpoint watchpoints[DEBUG_MAX_WATCHPOINTS];
+    int num_watchpoints;
+
+    // Mask of WATCH_* bits for registers that stop execution when they change
+    uint32_t reg_watch;
+
+    // Set when execution should stop after the next instruction
+    int stepping;
+
+    // Set while execution is halted
+    int stopped;
+    int stop_reason;
+
+    // Address that triggered the last watchpoint stop
+    uint16_t stop_address;
+
+    // Don't re-trigger the breakpoint we just resumed from
+    int skip_breakpoint;
+
+    // GDB remote serial protocol connection (-1 when not connected)
+    int listen_fd;
+    int client_fd;
+
+    // Receive buffer; packets can span several reads
+    char gdb_in[GDB_MAX_PACKET * 2];
+    int gdb_in_len;
+
+    // Whether the client has been told about the current stop
+    int stop_reported;
+
+    // Records every instruction run under the debugger, or NULL
+    struct trace* trace;
+} debugger;
+
+// Breakpoint/watchpoint engine
+debugger* debugger_create();
+void debugger_destroy(debugger* d);
+int debugger_active(debugger* d);
+uint16_t debug_cycle(debugger* d, struct chip* c, struct CPU* cpu);
+void debugger_resume(debugger* d, int step);
+
+void debugger_add_breakpoint(debugger* d, uint16_t address);
+void debugger_remove_breakpoint(debugger* d, uint16_t address);
+int debugger_add_watchpoint(debugger* d, uint16_t address, uint16_t length);
+void debugger_remove_watchpoint(debugger* d, uint16_t address, uint16_t length);
+
+// GDB remote stub
+int debugger_listen(debugger* d, int port);
+int debugger_poll(debugger* d, struct chip* c, struct CPU* cpu, int timeout_ms);
@@ -0,0 +1,154 @@
+#include <string.h>
+#include "cpu.h"
+#include "delta.h"
+
+// Run-length encodes n bytes, returning the encoded length.
+static size_t rle_encode(const uint8_t* in, int n, uint8_t* out) {
+    size_t len = 0;
+    int i = 0;
+
+    while (i < n) {
+        int start = i;
+        if (in[i] == 0) {
+            while (i < n && in[i] == 0 && i - start < 127) {
+                i++;
+            }
+            out[len++] = i - start;
+        } else {
+            while (i < n && in[i] != 0 && i - start < 127) {
+                i++;
+            }
+            out[len++] = 0x80 | (i - start);
+            memcpy(out + len, in + start, i - start);
+            len += i - start;
+        }
+    }
+
+    return len;
+}
+
+static void put16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void put32(uint8_t* out, uint32_t value) {
+    put16(out, value & 0xFFFF);
+    put16(out + 2, value >> 16);
+}
+
+// Encodes the rows of the current screen that differ from prev into out
+// (which must hold DELTA_MAX_MESSAGE bytes) and updates prev to match.
+// Returns the message length, or 0 if nothing changed.
+size_t encode_delta(chip* c, screen_copy* prev, uint8_t* out) {
+    size_t len = DELTA_HEADER;
+    int rows = 0;
+
+    for (int y = 0; y < HIRES_HEIGHT; y++) {
+        uint64_t changed = 0;
+        for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+            for (int w = 0; w < SCREEN_WORDS; w++) {
+                changed |= c->game_screen[plane][y][w] ^ prev->screen[plane][y][w];
+            }
+        }
+        if (!changed) {
+            continue;
+        }
+
+        // XOR of the row, most significant byte first so bytes run left to right
+        uint8_t row[DELTA_ROW_BYTES];
+        int i = 0;
+        for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+            for (int w = 0; w < SCREEN_WORDS; w++) {
+                uint64_t x = c->game_screen[plane][y][w] ^ prev->screen[plane][y][w];
+                for (int b = 7; b >= 0; b--) {
+                    row[i++] = x >> (b * 8);
+                }
+                prev->screen[plane][y][w] = c->game_screen[plane][y][w];
+            }
+        }
+
+        // Alternating zero and nonzero bytes would grow to half again the
+        // row's size, so those rows go out as a single literal run instead
+        uint8_t rle[DELTA_ROW_BYTES * 2];
+        size_t rle_len = rle_encode(row, DELTA_ROW_BYTES, rle);
+        out[len++] = y;
+        if (rle_len > 1 + DELTA_ROW_BYTES) {
+            out[len++] = 0x80 | DELTA_ROW_BYTES;
+            memcpy(out + len, row, DELTA_ROW_BYTES);
+            len += DELTA_ROW_BYTES;
+        } else {
+            memcpy(out + len, rle, rle_len);
+            len += rle_len;
+        }
+        rows++;
+    }
+
+    if (rows == 0 && prev->hires == c->hires) {
+        return 0;
+    }
+    prev->hires = c->hires;
+
+    out[0] = DELTA_FRAME;
+    out[1] = c->hires ? DELTA_HIRES : 0;
+    put16(out + 2, rows);
+    put32(out + 4, len - DELTA_HEADER);
+
+    return len;
+}
+
+// Applies a complete frame message to a screen copy. Returns 0 if the message is malformed.
+int apply_delta(const uint8_t* msg, size_t len, screen_copy* screen) {
+    if (len < DELTA_HEADER || msg[0] != DELTA_FRAME) {
+        return 0;
+    }
+
+    int rows = msg[2] | msg[3] << 8;
+    size_t payload = msg[4] | msg[5] << 8 | msg[6] << 16 | (uint32_t) msg[7] << 24;
+    if (DELTA_HEADER + payload != len) {
+        return 0;
+    }
+    screen->hires = msg[1] & DELTA_HIRES;
+
+    size_t pos = DELTA_HEADER;
+    for (int r = 0; r < rows; r++) {
+        if (pos >= len || msg[pos] >= HIRES_HEIGHT) {
+            return 0;
+        }
+        int y = msg[pos++];
+
+        // Decode the row's XOR bytes
+        uint8_t row[DELTA_ROW_BYTES];
+        int i = 0;
+        while (i < DELTA_ROW_BYTES) {
+            if (pos >= len) {
+                return 0;
+            }
+            int control = msg[pos++];
+            int run = control & 0x7F;
+            if (run == 0 || i + run > DELTA_ROW_BYTES || (control & 0x80 && pos + run > len)) {
+                return 0;
+            }
+            if (control & 0x80) {
+                memcpy(row + i, msg + pos, run);
+                pos += run;
+            } else {
+                memset(row + i, 0, run);
+            }
+            i += run;
+        }
+
+        i = 0;
+        for (int plane = 0; plane < SCREEN_PLANES; plane++) {
+            for (int w = 0; w < SCREEN_WORDS; w++) {
+                uint64_t x = 0;
+                for (int b = 0; b < 8; b++) {
+                    x = x << 8 | row[i++];
+                }
+                screen->screen[plane][y][w] ^= x;
+            }
+        }
+    }
+
+    return pos == len;
+}
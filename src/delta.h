@@ -0,0 +1,35 @@
+#include <inttypes.h>
+#include <stddef.h>
+
+// Frame updates carry only the screen rows that changed since the last update
+// the receiver has, as the XOR of old and new row, run-length encoded.
+//
+// Message layout (little-endian):
+//   uint8  'F'
+//   uint8  flags (DELTA_HIRES)
+//   uint16 number of changed rows
+//   uint32 payload length in bytes
+//   payload: per changed row, the row number followed by the RLE'd XOR of the
+//   row's DELTA_ROW_BYTES bytes (plane 0 then plane 1, leftmost pixel in the
+//   most significant bit of the first byte)
+//
+// RLE control bytes: 0x01-0x7F is a run of that many zero bytes; 0x81-0xFF is
+// followed by (control & 0x7F) literal bytes.
+#define DELTA_FRAME 'F'
+#define DELTA_HIRES 0x01
+#define DELTA_HEADER 8
+#define DELTA_ROW_BYTES (SCREEN_PLANES * SCREEN_WORDS * 8)
+
+// Largest possible message: every row changed, each sent as a row number
+// and one literal run (the encoder never lets a row get bigger than that,
+// which needs DELTA_ROW_BYTES to fit a single run)
+#define DELTA_MAX_MESSAGE (DELTA_HEADER + HIRES_HEIGHT * (2 + DELTA_ROW_BYTES))
+
+// The screen as last sent to (or received by) the other side
+typedef struct screen_copy {
+    uint64_t screen[SCREEN_PLANES][HIRES_HEIGHT][SCREEN_WORDS];
+    uint8_t hires;
+} screen_copy;
+
+size_t encode_delta(chip* c, screen_copy* prev, uint8_t* out);
+int apply_delta(const uint8_t* msg, size_t len, screen_copy* screen);
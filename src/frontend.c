@@ -0,0 +1,611 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "frontend.h"
+#include "keypad.h"
+#include "trace.h"
+#include "debugger.h"
+#include "stats.h"
+#include "capture.h"
+#include "present.h"
+#include "quirks.h"
+#include "timing.h"
+#include "latency.h"
+
+// Frames the emulation may fall behind wall time before it stops catching up
+#define MAX_LAG_FRAMES 15
+
+// Slowest slow motion, and the most cycles a frame can be given
+#define MAX_SLOW_MOTION 8
+#define MAX_FRAME_CYCLES 1000000
+
+// Nanoseconds from one time to a later one
+static uint64_t elapsed_ns(const struct timespec* from, const struct timespec* to) {
+    return (to->tv_sec - from->tv_sec) * 1000000000ULL + (to->tv_nsec - from->tv_nsec);
+}
+
+// Speed hotkeys, outside of the default keypad layout:
+//   Tab        turbo: run as fast as possible, presenting at most at the display rate
+//   Backspace  slow motion: 1/2, 1/4 and 1/8 speed, then back to normal
+//   [ and ]    a fifth fewer or a quarter more cycles per frame
+// Returns whether the speed changed.
+static int speed_hotkey(SDL_Scancode key, emu_clock* clock, int* turbo, int* slow) {
+    switch (key) {
+        case SDL_SCANCODE_TAB:
+            *turbo = !*turbo;
+            *slow = 1;
+            return 1;
+        case SDL_SCANCODE_BACKSPACE:
+            *turbo = 0;
+            *slow = *slow < MAX_SLOW_MOTION ? *slow * 2 : 1;
+            return 1;
+        case SDL_SCANCODE_LEFTBRACKET:
+            if (clock->frame_cycles > 1) {
+                clock->frame_cycles -= (clock->frame_cycles + 4) / 5;
+                return 1;
+            }
+            return 0;
+        case SDL_SCANCODE_RIGHTBRACKET:
+            if (clock->frame_cycles < MAX_FRAME_CYCLES) {
+                clock->frame_cycles += (clock->frame_cycles + 3) / 4;
+                return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Shows the speed in the window title.
+static void show_speed(SDL_Window* win, emu_clock* clock, int turbo, int slow) {
+    char title[96];
+    int len = snprintf(title, sizeof(title), "CHIP-8 Emulator - %" PRIu32 " %s per frame", clock->frame_cycles,
+                       clock->model == TIMING_FIXED ? "instructions" : "cycles");
+    if (turbo) {
+        snprintf(title + len, sizeof(title) - len, ", turbo");
+    } else if (slow > 1) {
+        snprintf(title + len, sizeof(title) - len, ", 1/%d speed", slow);
+    }
+    SDL_SetWindowTitle(win, title);
+}
+
+// Emulates the CHIP8 CPU. You can choose to initialize the CPU struct
+// from outside the run() method, which in that case you bear the responsibility
+// of tearing it down. The same goes for any recorders passed in through opts.
+void run(chip* c, CPU* cpu, run_options* opts) {
+    // Initialize CPU
+    int is_cpu_provided = 1;
+    if (cpu == NULL) {
+        cpu = initialize();
+        is_cpu_provided = 0;
+    }
+
+    trace* tracer = opts != NULL ? opts->trace : NULL;
+    debugger* dbg = opts != NULL ? opts->debugger : NULL;
+    stats* st = opts != NULL ? opts->stats : NULL;
+    capture* cap = opts != NULL ? opts->capture : NULL;
+
+    present_options default_present;
+    present_options* look = opts != NULL ? opts->present : NULL;
+    if (look == NULL) {
+        present_default_options(&default_present);
+        look = &default_present;
+    }
+
+    // The debugger's dispatch path is only used while it has something to
+    // check, so an idle debugger costs nothing per instruction. It traces
+    // what it runs, so -t and -g work together.
+    if (dbg != NULL) {
+        dbg->trace = tracer;
+    }
+    int debugging = dbg != NULL && debugger_active(dbg);
+
+    // Key bindings
+    keymap default_keys;
+    keymap* keys = opts != NULL ? opts->keymap : NULL;
+    if (keys == NULL) {
+        default_keymap(&default_keys);
+        keys = &default_keys;
+    }
+
+    // Counters for the current frame, published to the stats segment once per frame
+    uint64_t frame_instructions = 0;
+    uint32_t frame_draws = 0; // presents, at most one per frame
+    uint64_t frame_overshoot_ns = 0;
+    uint32_t frame_sleeps = 0;
+
+    // Initialize graphics
+    if (SDL_Init(SDL_INIT_VIDEO) != 0){
+        // printf("SDL_Init Error: %s", SDL_GetError());
+        return;
+    }
+
+    // The window matches the streaming texture, so the renderer copies it 1:1
+    int width = HIRES_WIDTH * look->scale;
+    int height = HIRES_HEIGHT * look->scale;
+    SDL_Window *win = SDL_CreateWindow("CHIP-8 Emulator", 100, 100, width, height, SDL_WINDOW_SHOWN);
+    SDL_Renderer *ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    SDL_Texture *tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (win == NULL || ren == NULL || tex == NULL) {
+        SDL_Log("SDL initialization failed: %s", SDL_GetError());
+        exit(1);
+    }
+
+    // Emulated time decides when frames end; wall time only paces them
+    emu_clock clock;
+    uint32_t instructions_per_frame = opts != NULL ? opts->instructions_per_frame : 0;
+    if (instructions_per_frame == 0) {
+        instructions_per_frame = CPU_CLOCK_SPEED / FRAMES_PER_SECOND;
+    }
+    clock_init(&clock, opts != NULL ? opts->timing : TIMING_FIXED, instructions_per_frame);
+
+    // Speed, switched with hotkeys: uncapped, or each frame taking slow times as long
+    int turbo = 0;
+    int slow = 1;
+
+    // Wall time at which frame 0 started, and at which the last frame ended
+    struct timespec start, frame_end, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    frame_end = start;
+    uint64_t first_frame = 0;
+
+    // Latency benchmark: the press being made (-1 before the first), when
+    // it started, when the next one is due, all from bench_start, and
+    // whether the emulator has seen it and the screen answered it yet. The
+    // first press waits a second for the ROM to start.
+    lag_bench* bench = opts != NULL ? opts->bench : NULL;
+    struct timespec bench_start = start;
+    int press = -1;
+    uint64_t press_ns = 0;
+    uint64_t next_press_ns = 1000000000ULL;
+    int press_seen = 0;
+    int press_answered = 0;
+    if (bench != NULL) {
+        bench->answered = 0;
+    }
+
+    // Screen as last presented. It starts blank, like the texture.
+    uint64_t shown[SCREEN_PLANES][HIRES_HEIGHT][SCREEN_WORDS] = {0};
+    uint8_t shown_hires = 0;
+    int drawn = 0;
+    int fading = 0;
+
+    // Handle keyboard/mouse input
+    SDL_Event event;
+    int quit = 0;
+
+    // CPU fetch/decode/execute loop
+    while (!quit) {
+        // 00FD exits the interpreter
+        if (c->halted) {
+            break;
+        }
+    
+        // While halted in the debugger, only service the GDB connection
+        if (dbg != NULL && dbg->stopped) {
+            debugger_poll(dbg, c, cpu, 10);
+            debugging = debugger_active(dbg);
+            continue;
+        }
+
+        // Run CPU cycle
+        uint16_t pc = cpu->pc;
+        uint16_t data = (uint16_t)(c->mem[pc] << 8 | c->mem[(uint16_t)(pc + 1)]);
+        uint16_t opcode;
+        if (debugging) {
+            opcode = debug_cycle(dbg, c, cpu);
+
+            // Stopped at a breakpoint before executing anything
+            if (opcode == 0 && cpu->pc == pc) {
+                continue;
+            }
+        } else if (tracer != NULL) {
+            opcode = trace_cycle(tracer, c, cpu);
+        } else {
+            opcode = cycle(c, cpu);
+        }
+        frame_instructions++;
+
+        // Draws and scrolls only mark the screen; it is presented once per frame
+        if (opcode == 0xD000) {
+            drawn = 1;
+        }
+
+        // Charge the instruction; the timers tick for every frame that
+        // completes. A VIP draw can end two frames at once.
+        int frames = clock_step(&clock, cpu, pc, data);
+        if (frames == 0) {
+            continue;
+        }
+
+        // Hand every frame to the recorder; it only copies the packed screen
+        for (int f = 0; f < frames && cap != NULL; f++) {
+            capture_frame(cap, c);
+        }
+
+        // Turbo runs uncapped and skips the wall clock work below (presenting,
+        // input, stats) for as many frames as it takes to keep that at the
+        // display rate, so the renderer never holds it back
+        uint64_t frame_ns = 1000000000ULL / FRAMES_PER_SECOND;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (turbo && elapsed_ns(&frame_end, &now) < frame_ns) {
+            continue;
+        }
+
+        if (cpu->st > 0) {
+            // TODO: play CHIP-8 sound
+            printf("\a");
+        }
+
+        // Games erase and redraw sprites all the time, so a frame often ends
+        // showing what the last one did. Present only when it doesn't, or
+        // while phosphor trails are still fading.
+        int changed = drawn && (c->hires != shown_hires || memcmp(shown, c->game_screen, sizeof(shown)) != 0);
+        drawn = 0;
+        if (changed || fading) {
+            memcpy(shown, c->game_screen, sizeof(shown));
+            shown_hires = c->hires;
+
+            // Expand the packed screen straight into the texture
+            void* pixels;
+            int pitch;
+            if (SDL_LockTexture(tex, NULL, &pixels, &pitch) == 0) {
+                fading = present_frame(c, pixels, pitch, look);
+                SDL_UnlockTexture(tex);
+            }
+
+            SDL_RenderCopy(ren, tex, NULL, NULL);
+            SDL_RenderPresent(ren);
+            frame_draws++;
+
+            // The first present after the emulator saw a press answers it
+            if (bench != NULL && press_seen && !press_answered) {
+                struct timespec presented;
+                clock_gettime(CLOCK_MONOTONIC, &presented);
+                bench->samples[bench->answered++] = elapsed_ns(&bench_start, &presented) - press_ns;
+                press_answered = 1;
+            }
+        }
+
+        // Sleep until the wall time of the next frame, stretched in slow
+        // motion. After falling far behind (stopped in the debugger, a slow
+        // host) start counting again from now rather than racing to catch up.
+        if (!turbo) {
+            uint64_t due_ns = (clock.frames - first_frame) * frame_ns * slow;
+            uint64_t now_ns = elapsed_ns(&start, &now);
+            if (now_ns < due_ns) {
+                struct timespec due = start;
+                due.tv_sec += due_ns / 1000000000ULL;
+                due.tv_nsec += due_ns % 1000000000ULL;
+                if (due.tv_nsec >= 1000000000L) {
+                    due.tv_sec++;
+                    due.tv_nsec -= 1000000000L;
+                }
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+                frame_sleeps++;
+
+                // Track how much later than requested the sleep ended
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                now_ns = elapsed_ns(&start, &now);
+                if (now_ns > due_ns) {
+                    frame_overshoot_ns += now_ns - due_ns;
+                }
+            } else if (now_ns - due_ns > MAX_LAG_FRAMES * frame_ns * slow) {
+                start = now;
+                first_frame = clock.frames;
+            }
+        }
+
+        // Publish this frame's counters
+        if (st != NULL) {
+            stats_frame(st, frame_instructions, frame_draws, elapsed_ns(&frame_end, &now), frame_overshoot_ns, frame_sleeps);
+        }
+        frame_end = now;
+        frame_instructions = 0;
+        frame_draws = 0;
+        frame_overshoot_ns = 0;
+        frame_sleeps = 0;
+
+        // Exit program, or change speed
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                quit = 1;
+            } else if (event.type == SDL_KEYDOWN && speed_hotkey(event.key.keysym.scancode, &clock, &turbo, &slow)) {
+                // Pace from here on at the new speed
+                start = now;
+                first_frame = clock.frames;
+                show_speed(win, &clock, turbo, slow);
+            }
+        }
+
+        // Sample the keypad once per frame; key instructions only test bits
+        c->keys = sample_keypad(keys);
+
+        // Benchmark presses are held like a real key, so they reach the
+        // emulator at the next sample after they start. A press not answered
+        // by the time the next one is due counts as unanswered. Gaps vary by
+        // up to a frame so presses land all over the frame.
+        if (bench != NULL) {
+            uint64_t bench_ns = elapsed_ns(&bench_start, &now);
+            if (bench_ns >= next_press_ns && press + 1 == bench->presses) {
+                quit = 1;
+            } else if (bench_ns >= next_press_ns) {
+                press++;
+                press_ns = next_press_ns;
+                press_seen = 0;
+                press_answered = 0;
+                next_press_ns += 2 * bench->hold_ns + rand() % (1000000000ULL / FRAMES_PER_SECOND);
+            }
+            if (press >= 0 && bench_ns < press_ns + bench->hold_ns) {
+                c->keys |= 1 << bench->key;
+                press_seen = 1;
+            }
+        }
+
+        // Check for interrupts and new breakpoints from GDB
+        if (dbg != NULL) {
+            debugger_poll(dbg, c, cpu, 0);
+            debugging = debugger_active(dbg);
+        }
+    }
+
+    // Teardown
+    if (!is_cpu_provided) {
+        free(cpu);
+    }
+
+    SDL_DestroyTexture(tex);
+    SDL_DestroyRenderer(ren);
+    SDL_DestroyWindow(win);
+    SDL_Quit();
+}
+
+static int compare_ns(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+// Prints the latencies measured by a benchmark run, in milliseconds.
+static void report_latency(lag_bench* bench) {
+    qsort(bench->samples, bench->answered, sizeof(uint64_t), compare_ns);
+    printf("key %X: %d/%d presses answered, input to present", bench->key, bench->answered, bench->presses);
+    double percentiles[] = {50, 90, 99, 100};
+    const char* names[] = {"p50", "p90", "p99", "max"};
+    for (int i = 0; i < 4; i++) {
+        printf(" %s %.2f", names[i], latency_percentile(bench->samples, bench->answered, percentiles[i]) / 1e6);
+    }
+    printf(" ms\n");
+}
+
+int main(int argc, char** argv) {
+    chip* chip = init();
+    run_options opts = {0};
+
+    // Optional flags:
+    //   -t <file>  record an execution trace (read it back with chip8-trace)
+    //   -g <port>  wait for GDB to attach on a local TCP port
+    //   -m <mode>  interpreter variant: chip8 (default), schip or xochip
+    //   -q <name>  quirk profile: modern, vip, schip or xochip (default picked per ROM)
+    //   -c <model> instruction timing: fixed (default) or vip
+    //   -i <count> instructions per frame with fixed timing (default 16)
+    //   -k <file>  load key bindings (lines of "<hex key> <SDL scancode name>")
+    //   -s         publish live stats for chip8-stat
+    //   -r <file>  record the display to a .gif, .y4m or .raw file
+    //   -z <scale> recording scale (default 4)
+    //   -p <list>  palette, up to four comma-separated RRGGBB colors
+    //   -x <scale> window scale in hires pixels, 1 to 20 (default 5)
+    //   -e <name>  display effect: scanlines or grid
+    //   -f         phosphor persistence: pixels fade out instead of flickering
+    //   -l <key>[:<presses>]  measure input-to-present latency by pressing a
+    //              keypad key (default 100 presses), then report and exit
+    int opt;
+    int gdb_port = 0;
+    int publish_stats = 0;
+    keymap keys;
+    char* record_file = NULL;
+    int record_scale = 0;
+    char* record_palette = NULL;
+    int quirks = -1;
+    present_options look;
+    present_default_options(&look);
+    opts.present = &look;
+    lag_bench bench = {.presses = 100, .hold_ns = 100000000};
+    while ((opt = getopt(argc, argv, "t:g:m:q:c:i:k:sr:z:p:x:e:fl:")) != -1) {
+        switch (opt) {
+            case 't':
+                opts.trace = trace_open(optarg);
+                if (opts.trace == NULL) {
+                    fprintf(stderr, "Could not open trace file %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'g':
+                gdb_port = atoi(optarg);
+                break;
+            case 'm':
+                if (strcmp(optarg, "schip") == 0) {
+                    chip->mode = MODE_SCHIP;
+                } else if (strcmp(optarg, "xochip") == 0) {
+                    chip->mode = MODE_XOCHIP;
+                } else if (strcmp(optarg, "chip8") != 0) {
+                    fprintf(stderr, "Unknown mode %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                quirks = parse_quirks(optarg);
+                if (quirks < 0) {
+                    fprintf(stderr, "Unknown quirk profile %s (modern, vip, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                opts.timing = parse_timing(optarg);
+                if (opts.timing < 0) {
+                    fprintf(stderr, "Unknown timing %s (fixed or vip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i':
+                opts.instructions_per_frame = strtoul(optarg, NULL, 10);
+                if (opts.instructions_per_frame < 1 || opts.instructions_per_frame > MAX_FRAME_CYCLES) {
+                    fprintf(stderr, "Instructions per frame must be 1 to %d\n", MAX_FRAME_CYCLES);
+                    return 1;
+                }
+                break;
+            case 'k':
+                if (!load_keymap(&keys, optarg)) {
+                    fprintf(stderr, "Could not load key bindings from %s\n", optarg);
+                    return 1;
+                }
+                opts.keymap = &keys;
+                break;
+            case 's':
+                publish_stats = 1;
+                break;
+            case 'r':
+                record_file = optarg;
+                break;
+            case 'z':
+                record_scale = atoi(optarg);
+                break;
+            case 'p':
+                record_palette = optarg;
+                if (!parse_palette(optarg, look.palette)) {
+                    fprintf(stderr, "Invalid palette %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'x':
+                look.scale = atoi(optarg);
+                if (look.scale < 1 || look.scale > PRESENT_MAX_SCALE) {
+                    fprintf(stderr, "Scale must be 1 to %d\n", PRESENT_MAX_SCALE);
+                    return 1;
+                }
+                break;
+            case 'e':
+                if (strcmp(optarg, "scanlines") == 0) {
+                    look.effect = PRESENT_SCANLINES;
+                } else if (strcmp(optarg, "grid") == 0) {
+                    look.effect = PRESENT_GRID;
+                } else {
+                    fprintf(stderr, "Unknown effect %s (scanlines or grid)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'f':
+                look.phosphor = calloc(1, sizeof(phosphor));
+                break;
+            case 'l': {
+                char* end;
+                bench.key = strtol(optarg, &end, 16);
+                if (*end == ':') {
+                    bench.presses = atoi(end + 1);
+                } else if (*end != '\0') {
+                    bench.presses = 0;
+                }
+                if (end == optarg || bench.key < 0 || bench.key > 0xF || bench.presses < 1) {
+                    fprintf(stderr, "Invalid latency benchmark %s (<hex key>[:<presses>])\n", optarg);
+                    return 1;
+                }
+                opts.bench = &bench;
+                break;
+            }
+            default:
+                fprintf(stderr, "usage: %s [-t trace file] [-g gdb port] [-m mode] [-q quirks] [-c timing] [-i instructions] [-k keymap] [-s] "
+                                "[-r recording [-z scale]] [-p palette] [-x scale] [-e effect] [-f] [-l key[:presses]] [rom]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // Fall back to a default ROM if no filename is given
+    char* filename = "../roms/BLINKY.ch8";
+    if (optind < argc) {
+        filename = argv[optind];
+    }
+
+    // Load ROM file into memory
+    load_rom(chip, filename);
+    chip->quirks = quirks >= 0 ? quirks : select_quirks(filename, chip->mode);
+
+    if (publish_stats) {
+        opts.stats = stats_create(filename);
+        if (opts.stats == NULL) {
+            fprintf(stderr, "Could not create stats segment\n");
+            return 1;
+        }
+    }
+
+    if (record_file != NULL) {
+        capture_options capture_opts;
+        capture_default_options(&capture_opts, record_file);
+        if (record_scale != 0) {
+            capture_opts.scale = record_scale;
+        }
+        if (record_palette != NULL) {
+            parse_palette(record_palette, capture_opts.palette);
+        }
+
+        opts.capture = capture_open(record_file, &capture_opts);
+        if (opts.capture == NULL) {
+            fprintf(stderr, "Could not open %s for recording\n", record_file);
+            return 1;
+        }
+    }
+
+    // Attach the debugger before the first instruction runs
+    if (gdb_port != 0) {
+        opts.debugger = debugger_create();
+        if (!debugger_listen(opts.debugger, gdb_port)) {
+            fprintf(stderr, "Could not listen for GDB on port %d\n", gdb_port);
+            return 1;
+        }
+    }
+
+    if (opts.bench != NULL) {
+        bench.samples = malloc(bench.presses * sizeof(uint64_t));
+        if (bench.samples == NULL) {
+            fprintf(stderr, "Could not set up %d presses\n", bench.presses);
+            return 1;
+        }
+    }
+
+    // Run the ROM
+    CPU* cpu = initialize();
+    run(chip, cpu, &opts);
+    if (chip->fault != FAULT_NONE) {
+        fprintf(stderr, "Stopped on %s at %04X\n", fault_name(chip->fault), cpu->pc);
+    }
+    free(cpu);
+
+    if (opts.bench != NULL) {
+        report_latency(&bench);
+        free(bench.samples);
+    }
+
+    // Flush the trace
+    if (opts.trace != NULL) {
+        trace_close(opts.trace);
+    }
+    if (opts.debugger != NULL) {
+        debugger_destroy(opts.debugger);
+    }
+    if (opts.stats != NULL) {
+        stats_destroy(opts.stats);
+    }
+    if (opts.capture != NULL) {
+        uint64_t dropped;
+        capture_close(opts.capture, &dropped);
+        if (dropped > 0) {
+            fprintf(stderr, "Recording dropped %" PRIu64 " frames\n", dropped);
+        }
+    }
+
+    // Free memory
+    free(look.phosphor);
+    free(chip);
+}
\ No newline at end of file
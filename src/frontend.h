@@ -0,0 +1,52 @@
+#include <SDL.h>
+
+// Input-to-present latency benchmark. run() presses a keypad key at set
+// wall times, as if it came from the keyboard, and times the
+// SDL_RenderPresent of the first changed frame after the emulator sees each
+// press. Only presses count, so the ROM should only redraw in answer to the
+// key.
+typedef struct lag_bench {
+    // Keypad key to press, how many times, and how long each press is held
+    int key;
+    int presses;
+    uint64_t hold_ns;
+
+    // Filled in by run(): wall time from each answered press to its
+    // present, with room for presses entries, and how many were answered
+    uint64_t* samples;
+    int answered;
+} lag_bench;
+
+// Optional features for run(). Passing NULL runs with everything disabled.
+typedef struct run_options {
+    // Keyboard bindings, or NULL for the default layout
+    struct keymap* keymap;
+
+    // Execution trace recorder, or NULL to disable tracing
+    struct trace* trace;
+
+    // Breakpoint/watchpoint engine, or NULL to run without a debugger
+    struct debugger* debugger;
+
+    // Live stats segment, or NULL to skip publishing
+    struct stats* stats;
+
+    // Video recorder, or NULL to skip capturing
+    struct capture* capture;
+
+    // Display scale, effect and colors, or NULL for the defaults
+    struct present_options* present;
+
+    // Emulated time model (TIMING_*): what an instruction costs and so how
+    // many run per 60 Hz frame
+    int timing;
+
+    // Instructions per frame with TIMING_FIXED at the start, or 0 for the
+    // default. The speed hotkeys change it while running.
+    uint32_t instructions_per_frame;
+
+    // Latency benchmark, or NULL to run normally. run() returns once it is done.
+    struct lag_bench* bench;
+} run_options;
+
+void run(chip* c, CPU* cpu, run_options* opts);
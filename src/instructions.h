@@ -1,5 +0,0 @@
-#include <SDL.h>
-
-// Keyboard-specific methods
-int key_to_v_register(SDL_KeyboardEvent event);
-SDL_KeyCode val_to_key(int idx);
@@ -0,0 +1,88 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "keypad.h"
+
+// Binds the 16 keys to the left side of the keyboard:
+//   1 2 3 4      0 1 2 3
+//   Q W E R  ->  4 5 6 7
+//   A S D F      8 9 A B
+//   Z X C V      C D E F
+void default_keymap(keymap* map) {
+    static const SDL_Scancode defaults[16] = {
+        SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4,
+        SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_R,
+        SDL_SCANCODE_A, SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_F,
+        SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_C, SDL_SCANCODE_V,
+    };
+
+    memcpy(map->keys, defaults, sizeof(defaults));
+}
+
+// Cuts a trailing comment (a '#' after whitespace, since "#" is itself a
+// scancode name) and trailing whitespace, including the '\r' of CRLF line
+// endings, off a scancode name.
+static void trim_name(char* name) {
+    for (char* hash = strchr(name, '#'); hash != NULL; hash = strchr(hash + 1, '#')) {
+        if (hash > name && isspace((unsigned char) hash[-1])) {
+            *hash = '\0';
+            break;
+        }
+    }
+
+    size_t len = strlen(name);
+    while (len > 0 && isspace((unsigned char) name[len - 1])) {
+        name[--len] = '\0';
+    }
+}
+
+// Loads key bindings on top of the defaults. Each line of the file holds a
+// CHIP-8 key in hex and an SDL scancode name, e.g. "A Z"; lines starting
+// with '#' are comments, and so is anything after " #". Returns 0 if the
+// file can't be read or is invalid.
+int load_keymap(keymap* map, const char* filename) {
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    default_keymap(map);
+
+    char line[128];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_number++;
+
+        unsigned int key;
+        char name[64];
+        if (line[0] == '#' || sscanf(line, "%x %63[^\n]", &key, name) != 2) {
+            continue;
+        }
+        trim_name(name);
+
+        SDL_Scancode scancode = SDL_GetScancodeFromName(name);
+        if (key > 0xF || scancode == SDL_SCANCODE_UNKNOWN) {
+            fprintf(stderr, "%s:%d: invalid binding\n", filename, line_number);
+            fclose(f);
+            return 0;
+        }
+        map->keys[key] = scancode;
+    }
+
+    fclose(f);
+    return 1;
+}
+
+// Reads the keyboard state once and packs it into a keypad mask.
+uint16_t sample_keypad(const keymap* map) {
+    const uint8_t *state = SDL_GetKeyboardState(NULL);
+    uint16_t keys = 0;
+
+    for (int i = 0; i < 16; i++) {
+        if (state[map->keys[i]]) {
+            keys |= 1 << i;
+        }
+    }
+
+    return keys;
+}
@@ -0,0 +1,11 @@
+#include <SDL.h>
+
+// SDL scancode bound to each of the 16 CHIP-8 keys
+typedef struct keymap {
+    SDL_Scancode keys[16];
+} keymap;
+
+// Keyboard-specific methods
+void default_keymap(keymap* map);
+int load_keymap(keymap* map, const char* filename);
+uint16_t sample_keypad(const keymap* map);
@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "state.h"
+#include "present.h"
+#include "quirks.h"
+#include "latency.h"
+
+static uint64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// Average cost of an instruction of this ROM on this host
+static uint64_t measure_instruction(const snapshot* start) {
+    chip* c = malloc(sizeof(chip));
+    CPU* cpu = malloc(sizeof(CPU));
+    snapshot_restore(start, c, cpu);
+
+    int count = 0;
+    uint64_t from = now_ns();
+    for (; count < 2000000 && !c->halted; count++) {
+        cycle(c, cpu);
+    }
+    uint64_t ns = (now_ns() - from) / (count > 0 ? count : 1);
+
+    free(cpu);
+    free(c);
+    return ns > 0 ? ns : 1;
+}
+
+// Cost of expanding a frame at the window's default scale. Uploading and
+// compositing come on top of this and depend on the graphics stack.
+static uint64_t measure_present(const snapshot* start) {
+    present_options opts;
+    present_default_options(&opts);
+    int width = HIRES_WIDTH * opts.scale;
+    uint32_t* pixels = malloc((size_t) width * HIRES_HEIGHT * opts.scale * sizeof(uint32_t));
+    chip* c = malloc(sizeof(chip));
+    memcpy(c, &start->c, sizeof(chip));
+
+    int count = 200;
+    uint64_t from = now_ns();
+    for (int i = 0; i < count; i++) {
+        present_frame(c, pixels, width * sizeof(uint32_t), &opts);
+    }
+    uint64_t ns = (now_ns() - from) / count;
+
+    free(c);
+    free(pixels);
+    return ns;
+}
+
+// The pacing run() actually uses: input and presents once per frame, on
+// the emulation thread, with a vsynced renderer
+static int is_frontend(const pacing* p) {
+    return p->schedule == SCHEDULE_FRAME && p->vsync && !p->threaded;
+}
+
+static void print_row(const pacing* p, int count, const uint64_t* samples, int trials) {
+    printf("%-11s %-5s %-8s %5d/%-5d", p->schedule == SCHEDULE_FRAME ? "frame" : "instruction",
+           p->vsync ? "on" : "off", p->threaded ? "threaded" : "inline", count, trials);
+    double percentiles[] = {50, 90, 99, 100};
+    for (int i = 0; i < 4; i++) {
+        printf(" %7.2f", latency_percentile(samples, count, percentiles[i]) / 1e6);
+    }
+    printf("%s\n", is_frontend(p) ? "  (frontend)" : "");
+}
+
+// Models how long a key press takes to show on screen under a range of
+// pacing designs (see latency.h):
+//   chip8-lagmodel [-k key] [-n presses] [-i instructions per frame] [-m mode] [-q quirks] rom
+// Each press is held for a few frames, and all designs see the same presses
+// at the same simulated times. Latencies are in milliseconds of simulated
+// time. This doesn't run the frontend or SDL, and only the row marked
+// "frontend" is a design run() implements; the rest are what-ifs. To
+// measure the frontend itself, run chip8 -l.
+int main(int argc, char** argv) {
+    latency_options opts = {
+        .key = 5,
+        .hold_ns = 100000000,
+        .trials = 200,
+        .timeout_frames = 30,
+        .instructions_per_frame = CPU_CLOCK_SPEED / FRAMES_PER_SECOND,
+        .seed = 1,
+    };
+    uint8_t mode = MODE_CHIP8;
+    int quirks = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:n:i:m:q:")) != -1) {
+        switch (opt) {
+            case 'k':
+                opts.key = strtol(optarg, NULL, 16) & 0xF;
+                break;
+            case 'n':
+                opts.trials = atoi(optarg);
+                break;
+            case 'i':
+                opts.instructions_per_frame = atoi(optarg);
+                break;
+            case 'm':
+                if (strcmp(optarg, "schip") == 0) {
+                    mode = MODE_SCHIP;
+                } else if (strcmp(optarg, "xochip") == 0) {
+                    mode = MODE_XOCHIP;
+                } else if (strcmp(optarg, "chip8") != 0) {
+                    fprintf(stderr, "Unknown mode %s (chip8, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                quirks = parse_quirks(optarg);
+                if (quirks < 0) {
+                    fprintf(stderr, "Unknown quirk profile %s (modern, vip, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (optind != argc - 1 || opts.trials < 1 || opts.instructions_per_frame < 1) {
+        fprintf(stderr, "usage: %s [-k key] [-n presses] [-i instructions per frame] [-m mode] [-q quirks] rom\n",
+                argv[0]);
+        return 1;
+    }
+
+    FILE* f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open ROM %s\n", argv[optind]);
+        return 1;
+    }
+    fclose(f);
+
+    snapshot* start = malloc(sizeof(snapshot));
+    chip* c = init();
+    c->mode = mode;
+    load_rom(c, argv[optind]);
+    c->quirks = quirks >= 0 ? quirks : select_quirks(argv[optind], mode);
+    CPU* cpu = initialize();
+    snapshot_save(start, c, cpu);
+    free(cpu);
+    free(c);
+
+    opts.instruction_ns = measure_instruction(start);
+    opts.present_ns = measure_present(start);
+    printf("Modeled latency in simulated time, not measured on the frontend (see chip8 -l)\n");
+    printf("key %X, %d instructions per frame, %" PRIu64 " ns per instruction, %" PRIu64 " us per present\n\n",
+           opts.key, opts.instructions_per_frame, opts.instruction_ns, opts.present_ns / 1000);
+    printf("schedule    vsync render   answered         p50     p90     p99     max\n");
+
+    uint64_t* samples = malloc(opts.trials * sizeof(uint64_t));
+    for (int schedule = SCHEDULE_FRAME; schedule <= SCHEDULE_INSTRUCTION; schedule++) {
+        for (int vsync = 1; vsync >= 0; vsync--) {
+            for (int threaded = 0; threaded <= 1; threaded++) {
+                pacing p = {.schedule = schedule, .vsync = vsync, .threaded = threaded};
+                int count = latency_run(start, &p, &opts, samples);
+                print_row(&p, count, samples, opts.trials);
+            }
+        }
+    }
+
+    free(samples);
+    free(start);
+
+    return 0;
+}
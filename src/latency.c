@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "state.h"
+#include "timing.h"
+#include "latency.h"
+
+#define FRAME_NS (1000000000ULL / FRAMES_PER_SECOND)
+
+static uint32_t next_random(uint32_t* x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// First vblank at or after t, with vblanks at phase + n * FRAME_NS
+static uint64_t next_vblank(uint64_t t, uint64_t phase) {
+    if (t <= phase) {
+        return phase;
+    }
+    return phase + (t - phase + FRAME_NS - 1) / FRAME_NS * FRAME_NS;
+}
+
+// When a frame presented at t reaches the display
+static uint64_t visible(uint64_t t, const pacing* p, const latency_options* opts, uint64_t phase) {
+    t += opts->present_ns;
+    return p->vsync ? next_vblank(t, phase) : t;
+}
+
+// Instructions run between two input samples
+static int batch_size(const pacing* p, const latency_options* opts) {
+    return p->schedule == SCHEDULE_FRAME ? opts->instructions_per_frame : 1;
+}
+
+// Runs a batch of instructions with the keypad in the given state, ticking
+// the timers on emulated time. Returns 0 if the machine stopped.
+static int run_batch(chip* c, CPU* cpu, emu_clock* clock, int count, uint16_t keys) {
+    c->keys = keys;
+    for (int i = 0; i < count && !c->halted; i++) {
+        uint16_t pc = cpu->pc;
+        uint16_t data = (uint16_t)(c->mem[pc] << 8 | c->mem[(uint16_t)(pc + 1)]);
+        cycle(c, cpu);
+        clock_step(clock, cpu, pc, data);
+    }
+    return !c->halted;
+}
+
+// Records the screen after every batch of a run without the key pressed.
+// Hashing only when the screen changed keeps this cheap at one instruction
+// per batch. Returns the number of batches run before the machine stopped.
+static int control_run(chip* c, CPU* cpu, emu_clock clock, int batch, int batches, uint64_t* screens) {
+    uint8_t last[sizeof(c->game_screen)];
+    memcpy(last, c->game_screen, sizeof(last));
+    uint64_t hash = screen_hash(c);
+
+    for (int j = 0; j < batches; j++) {
+        if (!run_batch(c, cpu, &clock, batch, 0)) {
+            return j;
+        }
+        if (memcmp(last, c->game_screen, sizeof(last)) != 0) {
+            memcpy(last, c->game_screen, sizeof(last));
+            hash = screen_hash(c);
+        }
+        screens[j] = hash;
+    }
+    return batches;
+}
+
+// Presses the key once at a random point of the first frame and follows
+// the pacing model until a presented frame differs from the control run.
+// Simulated time starts at 0 with batch j due at j * slot. Returns whether
+// there was an answer in time, and if so the press-to-display latency.
+static int trial(chip* c, CPU* cpu, emu_clock* clock, const pacing* p, const latency_options* opts,
+                 const uint64_t* screens, int batches, uint32_t* seed, uint64_t* latency) {
+    int batch = batch_size(p, opts);
+    uint64_t slot = FRAME_NS * batch / opts->instructions_per_frame;
+    uint64_t press = next_random(seed) % FRAME_NS;
+    uint64_t phase = next_random(seed) % FRAME_NS;
+    uint64_t release = press + opts->hold_ns;
+
+    uint8_t shown[sizeof(c->game_screen)];
+    memcpy(shown, c->game_screen, sizeof(shown));
+
+    // When the emulation can run its next batch, and when the render thread
+    // is done with its current frame. A thread that is still busy keeps only
+    // the newest frame given to it and starts on that one when it is done.
+    uint64_t busy = 0;
+    uint64_t render_free = 0;
+    int pending = 0;
+
+    for (int j = 0; j < batches; j++) {
+        uint64_t start = j * slot > busy ? j * slot : busy;
+        uint16_t keys = start >= press && start < release ? 1 << opts->key : 0;
+        if (!run_batch(c, cpu, clock, batch, keys)) {
+            return 0;
+        }
+        uint64_t end = start + batch * opts->instruction_ns;
+        busy = end;
+
+        if (memcmp(shown, c->game_screen, sizeof(shown)) == 0) {
+            continue;
+        }
+        memcpy(shown, c->game_screen, sizeof(shown));
+
+        // A present blocks the emulation until it is done, and with vsync
+        // until the vblank it waited for, unless a render thread takes it
+        uint64_t display;
+        if (!p->threaded) {
+            display = visible(end, p, opts, phase);
+            busy = display;
+        } else {
+            if (pending && render_free <= end) {
+                render_free = visible(render_free, p, opts, phase);
+                pending = 0;
+            }
+            if (render_free <= end) {
+                render_free = visible(end, p, opts, phase);
+                display = render_free;
+            } else {
+                // Replaced if another frame comes first, but that one would show at the same time
+                pending = 1;
+                display = visible(render_free, p, opts, phase);
+            }
+        }
+
+        if (screen_hash(c) != screens[j]) {
+            *latency = display - press;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int compare_samples(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+// Measures opts->trials presses, one after the other from start: each
+// begins where the previous one stopped. Writes the latencies of the
+// answered presses into samples in increasing order and returns how many
+// there were.
+int latency_run(const snapshot* start, const pacing* p, const latency_options* opts, uint64_t* samples) {
+    chip* c = malloc(sizeof(chip));
+    CPU* cpu = malloc(sizeof(CPU));
+    chip* control = malloc(sizeof(chip));
+    CPU* control_cpu = malloc(sizeof(CPU));
+    snapshot_restore(start, c, cpu);
+
+    int batch = batch_size(p, opts);
+    int batches = opts->timeout_frames * opts->instructions_per_frame / batch;
+    uint64_t* screens = malloc(batches * sizeof(uint64_t));
+
+    emu_clock clock;
+    clock_init(&clock, TIMING_FIXED, opts->instructions_per_frame);
+    uint32_t seed = opts->seed != 0 ? opts->seed : 1;
+    int count = 0;
+
+    for (int i = 0; i < opts->trials && !c->halted; i++) {
+        memcpy(control, c, sizeof(chip));
+        memcpy(control_cpu, cpu, sizeof(CPU));
+        int ran = control_run(control, control_cpu, clock, batch, batches, screens);
+
+        if (trial(c, cpu, &clock, p, opts, screens, ran, &seed, &samples[count])) {
+            count++;
+        }
+    }
+
+    qsort(samples, count, sizeof(uint64_t), compare_samples);
+
+    free(screens);
+    free(control_cpu);
+    free(control);
+    free(cpu);
+    free(c);
+
+    return count;
+}
+
+// Nearest-rank percentile (p from 0 to 100) of sorted samples
+uint64_t latency_percentile(const uint64_t* sorted, int count, double p) {
+    if (count == 0) {
+        return 0;
+    }
+    int rank = (int)(p / 100 * count + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[rank > count ? count - 1 : rank - 1];
+}
@@ -0,0 +1,55 @@
+#include <inttypes.h>
+
+// Input-to-display latency model. Key presses are injected at known points
+// in simulated wall time and the emulator runs under a pacing model that
+// decides when input is sampled, when frames are presented and when they
+// reach the display. A press counts as answered by the first present whose
+// screen differs from a control run of the same state without the press,
+// and its latency runs from the press to that present becoming visible.
+//
+// The emulation itself is real; only time is simulated, using measured
+// costs for instructions and presents, so every configuration sees exactly
+// the same presses and runs far faster than real time. Nothing here runs
+// run(), SDL or a real display, so results are estimates of a design, not
+// measurements of the frontend; of the pacings below, run() only does
+// SCHEDULE_FRAME with vsync, inline. run() measures its own latency when
+// given a lag_bench (chip8 -l); latency_percentile() serves both.
+
+// When input is sampled and the screen presented
+#define SCHEDULE_FRAME       0 // once per frame, like run()
+#define SCHEDULE_INSTRUCTION 1 // before every instruction, and after every draw
+
+typedef struct pacing {
+    // One of the SCHEDULE_* values
+    int schedule;
+
+    // Presented frames only become visible at the next vblank
+    int vsync;
+
+    // Presenting happens on a render thread, so the emulation never waits for it
+    int threaded;
+} pacing;
+
+typedef struct latency_options {
+    // Keypad key to press, and for how long
+    int key;
+    uint64_t hold_ns;
+
+    // Presses to measure, and the frames to wait for an answer to each
+    int trials;
+    int timeout_frames;
+
+    int instructions_per_frame;
+
+    // Simulated cost of running an instruction and of presenting a frame
+    uint64_t instruction_ns;
+    uint64_t present_ns;
+
+    // Seed for the press times and the display's vblank phase
+    uint32_t seed;
+} latency_options;
+
+struct snapshot;
+
+int latency_run(const struct snapshot* start, const pacing* p, const latency_options* opts, uint64_t* samples);
+uint64_t latency_percentile(const uint64_t* sorted, int count, double p);
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "state.h"
+#include "lockstep.h"
+#include "trace.h"
+#include "debugger.h"
+
+static uint16_t step_cycle(void* ctx, chip* c, CPU* cpu) {
+    (void) ctx;
+    return cycle(c, cpu);
+}
+
+// The unspecialized interpreter, checking quirk flags as it goes
+static uint16_t step_generic(void* ctx, chip* c, CPU* cpu) {
+    (void) ctx;
+    return cycle_generic(c, cpu);
+}
+
+// Tracing to nowhere still runs the whole recording path
+static void* open_trace(void) {
+    return trace_open("/dev/null");
+}
+
+static void close_trace(void* ctx) {
+    trace_close(ctx);
+}
+
+static uint16_t step_trace(void* ctx, chip* c, CPU* cpu) {
+    return trace_cycle(ctx, c, cpu);
+}
+
+static void* open_debugger(void) {
+    return debugger_create();
+}
+
+static void close_debugger(void* ctx) {
+    debugger_destroy(ctx);
+}
+
+static uint16_t step_debugger(void* ctx, chip* c, CPU* cpu) {
+    return debug_cycle(ctx, c, cpu);
+}
+
+const backend backends[] = {
+    {"cycle", NULL, NULL, step_cycle},
+    {"generic", NULL, NULL, step_generic},
+    {"trace", open_trace, close_trace, step_trace},
+    {"debugger", open_debugger, close_debugger, step_debugger},
+    {NULL, NULL, NULL, NULL},
+};
+
+const backend* find_backend(const char* name) {
+    for (const backend* b = backends; b->name != NULL; b++) {
+        if (strcmp(b->name, name) == 0) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+// One backend's run
+typedef struct lane {
+    const backend* be;
+    void* ctx;
+    chip* c;
+    CPU cpu;
+} lane;
+
+// Returns the keypad mask for a frame.
+static uint16_t keys_for_frame(const lockstep_options* opts, uint64_t frame) {
+    int lo = 0;
+    int hi = opts->input_count;
+
+    // Find the last event at or before the frame
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (opts->input[mid].frame <= frame) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? opts->input[lo - 1].keys : 0;
+}
+
+// Runs count instructions starting at instruction n of the run. Frame
+// boundaries tick the timers and sample the input the same way for both lanes.
+static void run_lane(lane* l, uint64_t n, uint64_t count, const lockstep_options* opts) {
+    uint64_t ipf = opts->instructions_per_frame;
+
+    for (uint64_t end = n + count; n < end; n++) {
+        if (n % ipf == 0) {
+            if (n > 0) {
+                if (l->cpu.dt > 0) {
+                    l->cpu.dt--;
+                }
+                if (l->cpu.st > 0) {
+                    l->cpu.st--;
+                }
+            }
+            l->c->keys = keys_for_frame(opts, n / ipf);
+        }
+        l->be->step(l->ctx, l->c, &l->cpu);
+    }
+}
+
+static int lanes_match(lane* a, lane* b) {
+    return state_hash(a->c, &a->cpu) == state_hash(b->c, &b->cpu);
+}
+
+// Rewinds both lanes to a snapshot and runs them count instructions from
+// instruction n, returning whether they still match.
+static int replay(lane* a, lane* b, const snapshot* from, uint64_t n, uint64_t count,
+                  const lockstep_options* opts) {
+    snapshot_restore(from, a->c, &a->cpu);
+    snapshot_restore(from, b->c, &b->cpu);
+    run_lane(a, n, count, opts);
+    run_lane(b, n, count, opts);
+    return lanes_match(a, b);
+}
+
+// Runs backends a and b from the same start state and compares them every
+// opts->interval instructions. If they diverge, the result holds the first
+// instruction after which their states differ, and diverged (if not NULL,
+// room for two snapshots) receives both states right after it. A divergence
+// that disappears again before the next comparison goes unnoticed.
+// Returns 0 if a backend or the buffers couldn't be set up.
+int lockstep_run(const backend* a, const backend* b, const snapshot* start,
+                 const lockstep_options* opts, lockstep_result* result, snapshot* diverged) {
+    lane lanes[2] = {{.be = a}, {.be = b}};
+    snapshot* good = malloc(sizeof(snapshot));
+    int ok = good != NULL;
+
+    for (int i = 0; i < 2; i++) {
+        lanes[i].c = malloc(sizeof(chip));
+        if (lanes[i].c == NULL) {
+            ok = 0;
+        } else {
+            snapshot_restore(start, lanes[i].c, &lanes[i].cpu);
+        }
+        if (lanes[i].be->open != NULL && (lanes[i].ctx = lanes[i].be->open()) == NULL) {
+            ok = 0;
+        }
+    }
+
+    memset(result, 0, sizeof(lockstep_result));
+    if (ok) {
+        // Last state both lanes agreed on, and its instruction count
+        *good = *start;
+        uint64_t good_n = 0;
+
+        uint64_t n = 0;
+        while (n < opts->instructions) {
+            uint64_t count = opts->instructions - n;
+            if (count > opts->interval) {
+                count = opts->interval;
+            }
+            run_lane(&lanes[0], n, count, opts);
+            run_lane(&lanes[1], n, count, opts);
+            n += count;
+
+            if (lanes_match(&lanes[0], &lanes[1])) {
+                snapshot_save(good, lanes[0].c, &lanes[0].cpu);
+                good_n = n;
+                result->checked = n;
+                if (lanes[0].c->halted) {
+                    break;
+                }
+                continue;
+            }
+
+            // Bisect for the first instruction count after which the lanes differ
+            uint64_t lo = 0;
+            uint64_t hi = n - good_n;
+            while (hi - lo > 1) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (replay(&lanes[0], &lanes[1], good, good_n, mid, opts)) {
+                    lo = mid;
+                } else {
+                    hi = mid;
+                }
+            }
+
+            // Stop just before it to see which instruction it is, then run it
+            replay(&lanes[0], &lanes[1], good, good_n, hi - 1, opts);
+            result->diverged = 1;
+            result->instruction = good_n + hi - 1;
+            result->pc = lanes[0].cpu.pc;
+            result->opcode = lanes[0].c->mem[result->pc] << 8 | lanes[0].c->mem[(uint16_t)(result->pc + 1)];
+            run_lane(&lanes[0], result->instruction, 1, opts);
+            run_lane(&lanes[1], result->instruction, 1, opts);
+
+            if (diverged != NULL) {
+                snapshot_save(&diverged[0], lanes[0].c, &lanes[0].cpu);
+                snapshot_save(&diverged[1], lanes[1].c, &lanes[1].cpu);
+            }
+            break;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (lanes[i].ctx != NULL) {
+            lanes[i].be->close(lanes[i].ctx);
+        }
+        free(lanes[i].c);
+    }
+    free(good);
+
+    return ok;
+}
@@ -0,0 +1,59 @@
+#include <inttypes.h>
+
+// Lockstep checking runs two execution backends over the same ROM and input
+// and compares their state periodically. On a mismatch it bisects back to
+// the first instruction after which the states differ.
+//
+// A backend must keep all emulated state in the chip and CPU structs, so
+// that restoring a snapshot rewinds it.
+typedef struct backend {
+    const char* name;
+
+    // Optional per-run context, created before the run and freed after it
+    void* (*open)(void);
+    void (*close)(void* ctx);
+
+    // Runs one instruction, like cycle()
+    uint16_t (*step)(void* ctx, chip* c, CPU* cpu);
+} backend;
+
+// Backends built into this tree, terminated by an entry with a NULL name
+extern const backend backends[];
+
+const backend* find_backend(const char* name);
+
+// Keypad input: the mask in effect from a frame on, sorted by frame
+typedef struct key_event {
+    uint64_t frame;
+    uint16_t keys;
+} key_event;
+
+typedef struct lockstep_options {
+    // Instructions to run, and how often to compare
+    uint64_t instructions;
+    uint64_t interval;
+
+    // Timers tick and input is sampled every this many instructions
+    int instructions_per_frame;
+
+    const key_event* input;
+    int input_count;
+} lockstep_options;
+
+typedef struct lockstep_result {
+    // Set if the backends diverged
+    int diverged;
+
+    // Instructions run by each backend before the first diverging one
+    uint64_t instruction;
+
+    // Address and opcode of the diverging instruction
+    uint16_t pc;
+    uint16_t opcode;
+
+    // Instructions that were checked
+    uint64_t checked;
+} lockstep_result;
+
+int lockstep_run(const backend* a, const backend* b, const snapshot* start,
+                 const lockstep_options* opts, lockstep_result* result, snapshot* diverged);
@@ -1,18 +1,21 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <GL/gl.h>
-#include <GL/freeglut.h>
 #include "cpu.h"
 
 // Initializes a CHIP8 emulation. 
 chip* init() {
-    // Allocate struct pointer and all internal members
-    chip* c = malloc(sizeof(chip));
+    // Allocate struct pointer and all internal members, starting with a blank screen
+    chip* c = calloc(1, sizeof(chip));
 
     // Initialize sprites
     init_sprites(c);
 
+    // Plain CHIP-8 drawing to the first bitplane
+    c->mode = MODE_CHIP8;
+    c->quirks = QUIRKS_MODERN;
+    c->planes = 1;
+
     return c;
 }
 
@@ -22,7 +25,7 @@ void load_rom(chip* chip, char* filename) {
     rom = fopen(filename, "rb");
 
     // Put the rom into the CHIP8's internal memory
-    fread(&chip->mem[0x200], 0xfff, 1, rom);
+    fread(&chip->mem[ROM_START], 1, EMU_MEMORY - ROM_START, rom);
     
     // Close the ROM file
     fclose(rom);
@@ -124,28 +127,25 @@ void init_sprites(chip* c) {
     c->mem[77] = 0xF0;
     c->mem[78] = 0x80;
     c->mem[79] = 0x80;
-}
-
-int main(int argc, char** argv) {
-    chip* chip = init();
-
-    // Require a filename be present (nothing more than 100 chars)
-    char* filename = malloc(100);
-    if (argc < 2) {
-        filename = "../roms/BLINKY.ch8";
-    } else {
-        filename = argv[1]; 
-    }
 
-    // Load ROM file into memory
-    load_rom(chip, filename);
-
-    // Run the ROM
-    run(chip, NULL);
-
-    // Free memory
-    free(chip);
-
-    // TODO: figure out why C doesn't want me freeing this filename string
-    // free(filename);
-}
\ No newline at end of file
+    // SUPER-CHIP 8x10 digits, extended to A-F as in XO-CHIP
+    static const uint8_t big_font[160] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0,
+    };
+    memcpy(&c->mem[BIG_FONT_START], big_font, sizeof(big_font));
+}
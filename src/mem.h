@@ -1,9 +1,13 @@
-// Memory space for CHIP8 is 4kb
-#define EMU_MEMORY 4096
+// Memory space for CHIP8 is 4kb; XO-CHIP extends it to 64kb
+#define EMU_MEMORY 65536
 
 // ROM data is loaded in starting at 0x200
 #define ROM_START 512
 
+// Font locations: 5-byte CHIP-8 digits, then 10-byte SUPER-CHIP digits
+#define FONT_START 0
+#define BIG_FONT_START 80
+
 // Stack stores up to 48 bytes
 #define STACK_SIZE 24
 
@@ -11,15 +15,78 @@
 #define SCREEN_HEIGHT 32
 #define SCREEN_WIDTH 64
 
+// SUPER-CHIP high resolution display
+#define HIRES_HEIGHT 64
+#define HIRES_WIDTH 128
+
+// The screen is bit-packed, one bit per pixel with the leftmost pixel in the
+// most significant bit of each 64-bit word. Low resolution only uses the
+// first word of the first 32 rows.
+#define SCREEN_WORDS (HIRES_WIDTH / 64)
+
+// XO-CHIP draws to two bitplanes
+#define SCREEN_PLANES 2
+
+// Emulator faults, which halt the machine
+#define FAULT_NONE 0
+#define FAULT_STACK_OVERFLOW 1  // 2nnn with every stack slot in use
+#define FAULT_STACK_UNDERFLOW 2 // 00EE with nothing to return to
+
+// Interpreter variants
+#define MODE_CHIP8 0
+#define MODE_SCHIP 1
+#define MODE_XOCHIP 2
+
+// Quirk profiles, for behaviour that differs between implementations
+#define QUIRKS_MODERN 0
+#define QUIRKS_VIP 1
+#define QUIRKS_SCHIP 2
+#define QUIRKS_XOCHIP 3
+#define QUIRK_PROFILES 4
+
 typedef struct chip {
-    // Memory 
+    // Memory
     uint8_t mem[EMU_MEMORY];
 
     // Game screen
-    uint8_t game_screen[SCREEN_HEIGHT][SCREEN_WIDTH];
+    uint64_t game_screen[SCREEN_PLANES][HIRES_HEIGHT][SCREEN_WORDS];
 
     // Stack memory
     uint16_t stack[STACK_SIZE];
+
+    // Interpreter variant (one of the MODE_* values)
+    uint8_t mode;
+
+    // Quirk profile the interpreter runs with (one of the QUIRKS_* values)
+    uint8_t quirks;
+
+    // Set in SUPER-CHIP 128x64 mode
+    uint8_t hires;
+
+    // XO-CHIP bitplanes selected for drawing, bit 0 being the first plane
+    uint8_t planes;
+
+    // Set once 00FD exits the interpreter, or on a fault
+    uint8_t halted;
+
+    // What stopped the machine if it wasn't 00FD (one of the FAULT_* values)
+    uint8_t fault;
+
+    // SUPER-CHIP persistent (RPL) flags saved by Fx75
+    uint8_t rpl[16];
+
+    // XO-CHIP audio pattern and pitch. These are stored but not played yet.
+    uint8_t audio[16];
+    uint8_t pitch;
+
+    // Keypad state, one bit per key (bit n set while key n is held). The
+    // frontend samples this once per frame.
+    uint16_t keys;
+
+    // Key that Fx0A saw go down and is waiting to be released, plus one
+    uint8_t key_pressed;
 } chip;
 
-void init_sprites(chip* c);
\ No newline at end of file
+chip* init();
+void load_rom(chip* chip, char* filename);
+void init_sprites(chip* c);
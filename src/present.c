@@ -0,0 +1,259 @@
+#include <string.h>
+#include "cpu.h"
+#include "present.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRESENT_X86
+#endif
+
+// Expands n palette indices into runs of width pixels each: width - 1
+// pixels from colors, then one from last (the same table unless drawing the grid).
+typedef void (*expand_fn)(const uint8_t* indices, int n, int width,
+                          const uint32_t* colors, const uint32_t* last, uint32_t* out);
+
+static void expand_scalar(const uint8_t* indices, int n, int width,
+                          const uint32_t* colors, const uint32_t* last, uint32_t* out) {
+    for (int i = 0; i < n; i++) {
+        uint32_t color = colors[indices[i]];
+        for (int k = 0; k < width - 1; k++) {
+            *out++ = color;
+        }
+        *out++ = last[indices[i]];
+    }
+}
+
+#ifdef PRESENT_X86
+// Fills each run with 4-pixel stores, the last one overlapping the previous
+// store when width isn't a multiple of 4.
+__attribute__((target("sse2")))
+static void expand_sse2(const uint8_t* indices, int n, int width,
+                        const uint32_t* colors, const uint32_t* last, uint32_t* out) {
+    if (width < 4) {
+        expand_scalar(indices, n, width, colors, last, out);
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        __m128i color = _mm_set1_epi32(colors[indices[i]]);
+        int k = 0;
+        for (; k + 4 <= width; k += 4) {
+            _mm_storeu_si128((__m128i*)(out + k), color);
+        }
+        if (k < width) {
+            _mm_storeu_si128((__m128i*)(out + width - 4), color);
+        }
+        out[width - 1] = last[indices[i]];
+        out += width;
+    }
+}
+
+// Same with 8-pixel stores
+__attribute__((target("avx2")))
+static void expand_avx2(const uint8_t* indices, int n, int width,
+                        const uint32_t* colors, const uint32_t* last, uint32_t* out) {
+    if (width < 8) {
+        expand_sse2(indices, n, width, colors, last, out);
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        __m256i color = _mm256_set1_epi32(colors[indices[i]]);
+        int k = 0;
+        for (; k + 8 <= width; k += 8) {
+            _mm256_storeu_si256((__m256i*)(out + k), color);
+        }
+        if (k < width) {
+            _mm256_storeu_si256((__m256i*)(out + width - 8), color);
+        }
+        out[width - 1] = last[indices[i]];
+        out += width;
+    }
+}
+#endif
+
+static const expand_fn kernels[] = {
+    expand_scalar,
+#ifdef PRESENT_X86
+    expand_sse2,
+    expand_avx2,
+#endif
+};
+
+static int selected_isa = -1;
+
+static int isa_supported(int isa) {
+#ifdef PRESENT_X86
+    __builtin_cpu_init();
+    if (isa == PRESENT_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (isa == PRESENT_SSE2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return isa == PRESENT_SCALAR;
+}
+
+// Returns the instruction set in use, picking the best one the CPU supports on first call.
+int present_isa() {
+    if (selected_isa < 0) {
+        selected_isa = PRESENT_SCALAR;
+        if (isa_supported(PRESENT_AVX2)) {
+            selected_isa = PRESENT_AVX2;
+        } else if (isa_supported(PRESENT_SSE2)) {
+            selected_isa = PRESENT_SSE2;
+        }
+    }
+    return selected_isa;
+}
+
+// Forces an instruction set. Returns 0 if this CPU doesn't support it.
+int present_set_isa(int isa) {
+    if (!isa_supported(isa)) {
+        return 0;
+    }
+    selected_isa = isa;
+    return 1;
+}
+
+void present_default_options(present_options* opts) {
+    // Fills the original 640x320 window
+    opts->scale = SCREEN_WIDTH * 10 / HIRES_WIDTH;
+    opts->effect = PRESENT_PLAIN;
+
+    // Same colors as before: the background black, then the plane combinations
+    opts->palette[0] = 0x000000;
+    opts->palette[1] = 0xFFFFFF;
+    opts->palette[2] = 0xAAAAAA;
+    opts->palette[3] = 0x555555;
+
+    opts->phosphor = NULL;
+}
+
+// Spreads the bits of a byte into 8 bytes, most significant bit first in memory
+static uint64_t spread[256];
+
+static void init_spread() {
+    for (int b = 0; b < 256; b++) {
+        uint8_t bytes[8];
+        for (int k = 0; k < 8; k++) {
+            bytes[k] = b >> (7 - k) & 1;
+        }
+        memcpy(&spread[b], bytes, sizeof(bytes));
+    }
+}
+
+// Unpacks one screen row into palette indices, 8 pixels at a time.
+static void unpack_row(chip* c, int y, int width, uint8_t* indices) {
+    for (int x = 0; x < width; x += 8) {
+        int shift = 56 - (x & 63);
+        uint8_t p0 = c->game_screen[0][y][x >> 6] >> shift;
+        uint8_t p1 = c->game_screen[1][y][x >> 6] >> shift;
+        uint64_t packed = spread[p0] | spread[p1] << 1;
+        memcpy(indices + x, &packed, sizeof(packed));
+    }
+}
+
+// Lit pixels restart their trail. Unlit ones fade by a frame and show what
+// is left of it, as index (frames left) * 4 + color into the extended
+// palette. Returns whether anything in the row is still glowing.
+static int fade_row(uint8_t* indices, uint8_t* trail, int width) {
+    int glowing = 0;
+
+    for (int x = 0; x < width; x++) {
+        if (indices[x] != 0) {
+            trail[x] = PHOSPHOR_FRAMES << 2 | indices[x];
+            indices[x] |= PHOSPHOR_FRAMES << 2;
+        } else if (trail[x] != 0) {
+            trail[x] = trail[x] >= 8 ? trail[x] - 4 : 0;
+            indices[x] = trail[x];
+            glowing |= trail[x];
+        }
+    }
+
+    return glowing != 0;
+}
+
+// Scales an 0xRRGGBB color down by 2^shift
+static uint32_t darken(uint32_t color, int shift) {
+    uint32_t mask = (0xFF >> shift) * 0x010101;
+    return color >> shift & mask;
+}
+
+// Moves an 0xRRGGBB color towards the background, keeping 1 / 2^shift of the difference
+static uint32_t fade(uint32_t color, uint32_t background, int shift) {
+    uint32_t out = 0;
+    for (int bit = 0; bit < 24; bit += 8) {
+        int from = background >> bit & 0xFF;
+        int to = color >> bit & 0xFF;
+        out |= (uint32_t)(from + (to - from) / (1 << shift)) << bit;
+    }
+    return out;
+}
+
+// Draws the screen into pixels (pitch in bytes), which must hold
+// HIRES_WIDTH x HIRES_HEIGHT times opts->scale pixels. With phosphor
+// persistence, returns whether pixels are still fading out, in which case
+// presenting again shows them fade further even if the screen is unchanged.
+int present_frame(chip* c, uint32_t* pixels, int pitch, const present_options* opts) {
+    if (spread[1] == 0) {
+        init_spread();
+    }
+    expand_fn expand = kernels[present_isa()];
+
+    // Output pixels per screen pixel, in both directions
+    int size = opts->scale << (c->hires ? 0 : 1);
+    int width = screen_width(c);
+    int height = screen_height(c);
+    size_t stride = pitch / sizeof(uint32_t);
+
+    // Color for each palette index. With phosphor persistence, index
+    // frames left * 4 + color: the top level is fully lit, each one below
+    // halfway closer to the background, and level 0 is the background.
+    phosphor* glow = opts->phosphor;
+    int levels = glow != NULL ? PHOSPHOR_FRAMES + 1 : 1;
+    uint32_t colors[4 * (PHOSPHOR_FRAMES + 1)];
+    uint32_t dim[4 * (PHOSPHOR_FRAMES + 1)];
+    for (int level = 0; level < levels; level++) {
+        for (int i = 0; i < 4; i++) {
+            int k = level * 4 + i;
+            uint32_t color = opts->palette[i];
+            if (levels > 1) {
+                color = level == 0 ? opts->palette[0] : fade(color, opts->palette[0], levels - 1 - level);
+            }
+            colors[k] = 0xFF000000 | color;
+            dim[k] = 0xFF000000 | darken(color, 1);
+        }
+    }
+
+    if (glow != NULL && glow->hires != c->hires) {
+        memset(glow->trail, 0, sizeof(glow->trail));
+        glow->hires = c->hires;
+    }
+    int glowing = 0;
+
+    // Effects need at least two output pixels per screen pixel
+    int effect = size > 1 ? opts->effect : PRESENT_PLAIN;
+    const uint32_t* last_column = effect == PRESENT_GRID ? dim : colors;
+    int bright_rows = effect == PRESENT_PLAIN ? size : size - 1;
+
+    uint8_t indices[HIRES_WIDTH];
+    for (int y = 0; y < height; y++) {
+        uint32_t* row = pixels + (size_t) y * size * stride;
+
+        unpack_row(c, y, width, indices);
+        if (glow != NULL) {
+            glowing |= fade_row(indices, glow->trail[y], width);
+        }
+        expand(indices, width, size, colors, last_column, row);
+        for (int r = 1; r < bright_rows; r++) {
+            memcpy(row + r * stride, row, width * size * sizeof(uint32_t));
+        }
+        if (bright_rows < size) {
+            expand(indices, width, size, dim, dim, row + (size - 1) * stride);
+        }
+    }
+
+    return glowing;
+}
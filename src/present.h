@@ -0,0 +1,56 @@
+#include <inttypes.h>
+
+// Presentation kernel: expands the packed screen into 32-bit ARGB pixels
+// (SDL_PIXELFORMAT_ARGB8888) at an integer scale, ready to be written
+// straight into a locked streaming texture.
+//
+// The output always covers HIRES_WIDTH x HIRES_HEIGHT pixels times the
+// scale; in low resolution every pixel is doubled. The cost grows with the
+// output size: the 0.2 ms per frame target holds at the default scale, and
+// large scales are bound by memory bandwidth instead.
+#define PRESENT_MAX_SCALE 20
+
+// Optional effects. Both darken to half brightness.
+#define PRESENT_PLAIN     0
+#define PRESENT_SCANLINES 1 // last output row of every pixel row
+#define PRESENT_GRID      2 // last output row and column of every pixel
+
+// Instruction sets for the row expansion, picked at runtime
+#define PRESENT_SCALAR 0
+#define PRESENT_SSE2   1
+#define PRESENT_AVX2   2
+
+// Phosphor persistence: a pixel that turns off stays visible for
+// PHOSPHOR_FRAMES - 1 more presented frames, halving in brightness each time
+#define PHOSPHOR_FRAMES 3
+
+struct chip;
+
+// Afterglow of the pixels that turned off, carried between frames. Start it
+// zeroed.
+typedef struct phosphor {
+    // Per screen pixel: frames of glow left times 4, plus the palette index it was lit with
+    uint8_t trail[64][128];
+
+    // Resolution the trail was recorded in
+    uint8_t hires;
+} phosphor;
+
+typedef struct present_options {
+    // Output pixels per hires pixel, 1 to PRESENT_MAX_SCALE
+    int scale;
+
+    // One of the PRESENT_* effects
+    int effect;
+
+    // 0xRRGGBB colors for each combination of the two bitplanes
+    uint32_t palette[4];
+
+    // Fading state for phosphor persistence, or NULL to show only the current frame
+    phosphor* phosphor;
+} present_options;
+
+void present_default_options(present_options* opts);
+int present_set_isa(int isa);
+int present_isa();
+int present_frame(struct chip* c, uint32_t* pixels, int pitch, const present_options* opts);
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "state.h"
+#include "quirks.h"
+
+static const char* const names[QUIRK_PROFILES] = {
+    [QUIRKS_MODERN] = "modern",
+    [QUIRKS_VIP] = "vip",
+    [QUIRKS_SCHIP] = "schip",
+    [QUIRKS_XOCHIP] = "xochip",
+};
+
+// ROMs known to need a particular profile, by rom_hash()
+typedef struct known_rom {
+    uint64_t hash;
+    uint8_t profile;
+    const char* name;
+} known_rom;
+
+static const known_rom known_roms[] = {
+    {0xD253CD80DE757002ULL, QUIRKS_SCHIP, "BLINKY (CHIP-48)"},
+    {0xF464511E0EC6548AULL, QUIRKS_VIP, "Maze"},
+    {0xEF6F6F962C54261AULL, QUIRKS_MODERN, "Particle Demo"},
+    {0x3C92EBC1AFE110A7ULL, QUIRKS_MODERN, "chip8-test-rom"},
+    {0xD35D5CAA906E946EULL, QUIRKS_MODERN, "test_opcode"},
+};
+
+// Returns the QUIRKS_* value for a profile name, or -1 if there is none.
+int parse_quirks(const char* name) {
+    for (int i = 0; i < QUIRK_PROFILES; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* quirks_name(int profile) {
+    return profile >= 0 && profile < QUIRK_PROFILES ? names[profile] : "unknown";
+}
+
+// Hashes the ROM file as it would be loaded. Returns 0 if it can't be read.
+uint64_t rom_hash(const char* filename) {
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    uint8_t* data = malloc(EMU_MEMORY - ROM_START);
+    size_t len = fread(data, 1, EMU_MEMORY - ROM_START, f);
+    fclose(f);
+
+    uint64_t hash = fnv1a(FNV_OFFSET, data, len);
+    free(data);
+    return hash;
+}
+
+// Returns the profile of a known ROM, or -1.
+int lookup_quirks(uint64_t hash) {
+    for (size_t i = 0; i < sizeof(known_roms) / sizeof(known_roms[0]); i++) {
+        if (known_roms[i].hash == hash) {
+            return known_roms[i].profile;
+        }
+    }
+    return -1;
+}
+
+// Picks the profile for a ROM: its own if it is known, otherwise the one
+// matching the interpreter mode.
+int select_quirks(const char* filename, uint8_t mode) {
+    int profile = lookup_quirks(rom_hash(filename));
+    if (profile >= 0) {
+        return profile;
+    }
+
+    switch (mode) {
+        case MODE_SCHIP:
+            return QUIRKS_SCHIP;
+        case MODE_XOCHIP:
+            return QUIRKS_XOCHIP;
+        default:
+            return QUIRKS_MODERN;
+    }
+}
@@ -0,0 +1,11 @@
+#include <inttypes.h>
+
+// Quirk profile selection. Known ROMs are recognized by a hash of the file
+// and get the profile they were written for; anything else falls back to
+// the usual profile for the interpreter mode.
+
+int parse_quirks(const char* name);
+const char* quirks_name(int profile);
+uint64_t rom_hash(const char* filename);
+int lookup_quirks(uint64_t hash);
+int select_quirks(const char* filename, uint8_t mode);
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "capture.h"
+#include "quirks.h"
+#include "timing.h"
+
+// Runs a ROM without a window as fast as possible and records its display:
+//   chip8-record [-m mode] [-q quirks] [-c timing] [-f frames] [-i instructions per frame]
+//                [-z scale] [-p palette] rom output.{gif,y4m,raw}
+// The recording plays back at the ROM's real speed.
+int main(int argc, char** argv) {
+    uint8_t mode = MODE_CHIP8;
+    long frames = 600;
+    int instructions_per_frame = CPU_CLOCK_SPEED / FRAMES_PER_SECOND;
+    int scale = 0;
+    const char* palette = NULL;
+    int quirks = -1;
+    int timing = TIMING_FIXED;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:q:c:f:i:z:p:")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "schip") == 0) {
+                    mode = MODE_SCHIP;
+                } else if (strcmp(optarg, "xochip") == 0) {
+                    mode = MODE_XOCHIP;
+                } else if (strcmp(optarg, "chip8") != 0) {
+                    fprintf(stderr, "Unknown mode %s (chip8, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                quirks = parse_quirks(optarg);
+                if (quirks < 0) {
+                    fprintf(stderr, "Unknown quirk profile %s (modern, vip, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                timing = parse_timing(optarg);
+                if (timing < 0) {
+                    fprintf(stderr, "Unknown timing %s (fixed or vip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'f':
+                frames = atol(optarg);
+                break;
+            case 'i':
+                instructions_per_frame = atoi(optarg);
+                break;
+            case 'z':
+                scale = atoi(optarg);
+                break;
+            case 'p':
+                palette = optarg;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "usage: %s [-m mode] [-q quirks] [-c timing] [-f frames] [-i instructions per frame] "
+                        "[-z scale] [-p rrggbb,rrggbb,rrggbb,rrggbb] rom output\n", argv[0]);
+        return 1;
+    }
+    const char* rom = argv[optind];
+    const char* output = argv[optind + 1];
+
+    FILE* f = fopen(rom, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open ROM %s\n", rom);
+        return 1;
+    }
+    fclose(f);
+
+    capture_options opts;
+    capture_default_options(&opts, output);
+    if (scale != 0) {
+        opts.scale = scale;
+    }
+    if (palette != NULL && !parse_palette(palette, opts.palette)) {
+        fprintf(stderr, "Invalid palette %s\n", palette);
+        return 1;
+    }
+
+    // Running faster than real time, so wait for the writer rather than drop frames
+    opts.wait = 1;
+
+    capture* cap = capture_open(output, &opts);
+    if (cap == NULL) {
+        fprintf(stderr, "Could not open %s for capture\n", output);
+        return 1;
+    }
+
+    chip* c = init();
+    c->mode = mode;
+    load_rom(c, (char*) rom);
+    c->quirks = quirks >= 0 ? quirks : select_quirks(rom, mode);
+    CPU* cpu = initialize();
+
+    // Frames end on emulated time, so the recording is the same however fast this runs
+    emu_clock clock;
+    clock_init(&clock, timing, instructions_per_frame);
+
+    while (clock.frames < (uint64_t) frames && !c->halted) {
+        uint16_t pc = cpu->pc;
+        uint16_t data = (uint16_t)(c->mem[pc] << 8 | c->mem[(uint16_t)(pc + 1)]);
+        cycle(c, cpu);
+        for (int done = clock_step(&clock, cpu, pc, data); done > 0; done--) {
+            capture_frame(cap, c);
+        }
+    }
+
+    uint64_t written = capture_close(cap, NULL);
+    printf("%" PRIu64 " frames written to %s\n", written, output);
+    if (c->fault != FAULT_NONE) {
+        fprintf(stderr, "Stopped on %s at %04X\n", fault_name(c->fault), cpu->pc);
+    }
+
+    free(cpu);
+    free(c);
+
+    return 0;
+}
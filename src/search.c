@@ -0,0 +1,658 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cpu.h"
+#include "state.h"
+#include "timing.h"
+#include "search.h"
+
+// Compact states keep the chip as the chunks that differ from the start
+#define CHUNK 64
+#define CHUNKS ((sizeof(chip) + CHUNK - 1) / CHUNK)
+
+// Chunks of memory. Memory comes first in the chip and is only written by
+// Fx33, Fx55 and 5xy2, so only the chunks those touched need comparing; the
+// rest of the chip is always compared.
+#define MEM_CHUNKS (EMU_MEMORY / CHUNK)
+
+// CPU registers, packed without padding the same way state_hash() does
+#define REGS 27
+
+#define NO_NODE UINT32_MAX
+
+// States a worker takes from the level at a time
+#define BATCH 64
+
+// A state of the level being searched, followed by its chunks
+typedef struct packed {
+    uint32_t node;
+    uint16_t chunks;
+    uint8_t regs[REGS];
+} packed;
+
+typedef struct packed_chunk {
+    uint16_t index;
+    uint8_t data[CHUNK];
+} packed_chunk;
+
+// Compact states one after the other
+typedef struct buffer {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} buffer;
+
+struct search;
+
+typedef struct worker {
+    struct search* s;
+    pthread_t thread;
+
+    // Working machine: the start state with the chunks in dirty patched over it
+    chip* c;
+    CPU cpu;
+    uint16_t dirty[CHUNKS];
+    int dirty_count;
+
+    // Memory chunks that may differ from the start, one bit each
+    uint64_t touched[MEM_CHUNKS / 64];
+
+    // Scratch for encoding the state just run
+    packed_chunk* diff;
+
+    // New states found, by parity of the level they belong to
+    buffer found[2];
+
+    uint64_t expanded;
+} worker;
+
+typedef struct search {
+    const search_options* opts;
+    const chip* start;
+
+    // Hashes of every state visited, open addressing with 0 for empty
+    _Atomic uint64_t* table;
+    uint64_t mask;
+
+    // How every state was reached: the state before it and the keys held
+    uint32_t* parents;
+    uint16_t* actions;
+    _Atomic uint32_t nodes;
+
+    // The level being searched, and the next of its states to hand out
+    packed** level;
+    uint64_t level_count;
+    _Atomic uint64_t next;
+    int depth;
+
+    // Set once the goal is reached or there is no room for more states
+    _Atomic int stop;
+    _Atomic uint32_t goal;
+    _Atomic int full;
+
+    worker* workers;
+} search;
+
+static const char* skip_space(const char* s) {
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    return s;
+}
+
+// Parses conditions joined by &&: a field (v0 to vf, i, pc, sp, dt, st or
+// mem[address]), a comparison (==, !=, <, <=, > or >=) and a number in C
+// syntax. Returns 0 if the text isn't one.
+int parse_predicate(const char* text, predicate* p) {
+    const char* s = skip_space(text);
+    p->count = 0;
+
+    for (;;) {
+        if (p->count == MAX_CONDITIONS) {
+            return 0;
+        }
+        condition* cond = &p->conditions[p->count++];
+
+        char name[8];
+        int len = 0;
+        while (isalnum((unsigned char) *s) && len < (int) sizeof(name) - 1) {
+            name[len++] = tolower((unsigned char) *s++);
+        }
+        name[len] = '\0';
+
+        cond->index = 0;
+        if (len == 2 && name[0] == 'v' && isxdigit((unsigned char) name[1])) {
+            cond->field = FIELD_V;
+            cond->index = strtol(name + 1, NULL, 16);
+        } else if (strcmp(name, "i") == 0) {
+            cond->field = FIELD_I;
+        } else if (strcmp(name, "pc") == 0) {
+            cond->field = FIELD_PC;
+        } else if (strcmp(name, "sp") == 0) {
+            cond->field = FIELD_SP;
+        } else if (strcmp(name, "dt") == 0) {
+            cond->field = FIELD_DT;
+        } else if (strcmp(name, "st") == 0) {
+            cond->field = FIELD_ST;
+        } else if (strcmp(name, "mem") == 0 && *s == '[') {
+            char* end;
+            unsigned long address = strtoul(s + 1, &end, 0);
+            if (end == s + 1 || *end != ']' || address >= EMU_MEMORY) {
+                return 0;
+            }
+            cond->field = FIELD_MEM;
+            cond->index = address;
+            s = end + 1;
+        } else {
+            return 0;
+        }
+
+        s = skip_space(s);
+        if (strncmp(s, "==", 2) == 0) {
+            cond->compare = COMPARE_EQ;
+        } else if (strncmp(s, "!=", 2) == 0) {
+            cond->compare = COMPARE_NE;
+        } else if (strncmp(s, "<=", 2) == 0) {
+            cond->compare = COMPARE_LE;
+        } else if (strncmp(s, ">=", 2) == 0) {
+            cond->compare = COMPARE_GE;
+        } else if (*s == '<') {
+            cond->compare = COMPARE_LT;
+        } else if (*s == '>') {
+            cond->compare = COMPARE_GT;
+        } else {
+            return 0;
+        }
+        s = skip_space(s + (cond->compare == COMPARE_LT || cond->compare == COMPARE_GT ? 1 : 2));
+
+        char* end;
+        cond->value = strtoul(s, &end, 0);
+        if (end == s) {
+            return 0;
+        }
+        s = skip_space(end);
+
+        if (*s == '\0') {
+            return 1;
+        }
+        if (strncmp(s, "&&", 2) != 0) {
+            return 0;
+        }
+        s = skip_space(s + 2);
+    }
+}
+
+int predicate_holds(const predicate* p, const chip* c, const CPU* cpu) {
+    for (int i = 0; i < p->count; i++) {
+        const condition* cond = &p->conditions[i];
+
+        uint32_t value = 0;
+        switch (cond->field) {
+            case FIELD_V:
+                value = cpu->v[cond->index];
+                break;
+            case FIELD_I:
+                value = cpu->address;
+                break;
+            case FIELD_PC:
+                value = cpu->pc;
+                break;
+            case FIELD_SP:
+                value = cpu->sp;
+                break;
+            case FIELD_DT:
+                value = cpu->dt;
+                break;
+            case FIELD_ST:
+                value = cpu->st;
+                break;
+            case FIELD_MEM:
+                value = c->mem[cond->index];
+                break;
+        }
+
+        int holds = 0;
+        switch (cond->compare) {
+            case COMPARE_EQ:
+                holds = value == cond->value;
+                break;
+            case COMPARE_NE:
+                holds = value != cond->value;
+                break;
+            case COMPARE_LT:
+                holds = value < cond->value;
+                break;
+            case COMPARE_LE:
+                holds = value <= cond->value;
+                break;
+            case COMPARE_GT:
+                holds = value > cond->value;
+                break;
+            case COMPARE_GE:
+                holds = value >= cond->value;
+                break;
+        }
+        if (!holds) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void pack_regs(const CPU* cpu, uint8_t* regs) {
+    memcpy(regs, cpu->v, 16);
+    regs[16] = cpu->address & 0xFF;
+    regs[17] = cpu->address >> 8;
+    regs[18] = cpu->pc & 0xFF;
+    regs[19] = cpu->pc >> 8;
+    regs[20] = cpu->sp;
+    regs[21] = cpu->dt;
+    regs[22] = cpu->st;
+    memcpy(regs + 23, &cpu->rng, sizeof(cpu->rng));
+}
+
+static void unpack_regs(const uint8_t* regs, CPU* cpu) {
+    memcpy(cpu->v, regs, 16);
+    cpu->address = regs[16] | regs[17] << 8;
+    cpu->pc = regs[18] | regs[19] << 8;
+    cpu->sp = regs[20];
+    cpu->dt = regs[21];
+    cpu->st = regs[22];
+    memcpy(&cpu->rng, regs + 23, sizeof(cpu->rng));
+}
+
+// Bytes of the chip in a chunk; the last one is cut short
+static size_t chunk_length(int index) {
+    size_t offset = (size_t) index * CHUNK;
+    return sizeof(chip) - offset < CHUNK ? sizeof(chip) - offset : CHUNK;
+}
+
+// Size of a compact state, rounded so the next one stays aligned
+static size_t packed_size(int chunks) {
+    size_t size = sizeof(packed) + chunks * sizeof(packed_chunk);
+    return (size + _Alignof(packed) - 1) / _Alignof(packed) * _Alignof(packed);
+}
+
+static packed_chunk* packed_chunks(packed* p) {
+    return (packed_chunk*)(p + 1);
+}
+
+// Makes room for size more bytes. Returns NULL if there is no memory for it.
+static void* buffer_add(buffer* b, size_t size) {
+    if (b->len + size > b->cap) {
+        size_t cap = b->cap > 0 ? b->cap * 2 : 1 << 20;
+        while (cap < b->len + size) {
+            cap *= 2;
+        }
+        uint8_t* data = realloc(b->data, cap);
+        if (data == NULL) {
+            return NULL;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    void* p = b->data + b->len;
+    b->len += size;
+    return p;
+}
+
+// Marks a state visited. Returns 0 if it was already.
+static int visit(search* s, uint64_t hash) {
+    hash = hash != 0 ? hash : 1;
+
+    for (uint64_t i = hash & s->mask;; i = (i + 1) & s->mask) {
+        uint64_t seen = atomic_load_explicit(&s->table[i], memory_order_relaxed);
+        if (seen == 0 && atomic_compare_exchange_strong_explicit(&s->table[i], &seen, hash, memory_order_relaxed,
+                                                                 memory_order_relaxed)) {
+            return 1;
+        }
+        if (seen == hash) {
+            return 0;
+        }
+    }
+}
+
+// Puts the worker's machine in a compact state. Only the chunks the last
+// state had patched need to go back to the start first.
+static void load(worker* w, packed* p) {
+    uint8_t* bytes = (uint8_t*) w->c;
+    const uint8_t* start = (const uint8_t*) w->s->start;
+
+    for (int i = 0; i < w->dirty_count; i++) {
+        size_t offset = (size_t) w->dirty[i] * CHUNK;
+        memcpy(bytes + offset, start + offset, chunk_length(w->dirty[i]));
+    }
+
+    packed_chunk* chunks = packed_chunks(p);
+    for (int i = 0; i < p->chunks; i++) {
+        memcpy(bytes + (size_t) chunks[i].index * CHUNK, chunks[i].data, chunk_length(chunks[i].index));
+        w->dirty[i] = chunks[i].index;
+        if (chunks[i].index < MEM_CHUNKS) {
+            w->touched[chunks[i].index / 64] |= 1ULL << chunks[i].index % 64;
+        }
+    }
+    w->dirty_count = p->chunks;
+
+    unpack_regs(p->regs, &w->cpu);
+}
+
+// Notes the memory an instruction is about to store to: at most 16 bytes from I.
+static void touch_stores(worker* w, uint16_t data) {
+    if ((data & 0xF0FF) != 0xF033 && (data & 0xF0FF) != 0xF055 && (data & 0xF00F) != 0x5002) {
+        return;
+    }
+    for (int end = 0; end < 16; end += 15) {
+        int index = (uint16_t)(w->cpu.address + end) / CHUNK;
+        w->touched[index / 64] |= 1ULL << index % 64;
+    }
+}
+
+// Holds keys for a step. Every step starts on a frame boundary, so the
+// timers tick the same way whichever states it runs between.
+static void run_step(worker* w, uint16_t keys) {
+    const search_options* opts = w->s->opts;
+    emu_clock clock;
+    clock_init(&clock, TIMING_FIXED, opts->instructions_per_frame);
+
+    w->c->keys = keys;
+    for (int frame = 0; frame < opts->frames_per_step; frame++) {
+        for (int i = 0; i < opts->instructions_per_frame && !w->c->halted; i++) {
+            uint16_t pc = w->cpu.pc;
+            uint16_t data = (uint16_t)(w->c->mem[pc] << 8 | w->c->mem[(uint16_t)(pc + 1)]);
+            touch_stores(w, data);
+            cycle(w->c, &w->cpu);
+            clock_step(&clock, &w->cpu, pc, data);
+        }
+    }
+
+    // The keys held are input, not state: the next step replaces them
+    w->c->keys = 0;
+}
+
+// Adds a chunk to the diff if it differs from the start, hashing it
+static int diff_chunk(worker* w, int index, int count, uint64_t* hash) {
+    size_t offset = (size_t) index * CHUNK;
+    size_t len = chunk_length(index);
+    const uint8_t* bytes = (const uint8_t*) w->c + offset;
+    if (memcmp(bytes, (const uint8_t*) w->s->start + offset, len) == 0) {
+        return count;
+    }
+
+    packed_chunk* chunk = &w->diff[count];
+    chunk->index = index;
+    memcpy(chunk->data, bytes, len);
+    *hash = fnv1a(*hash, &chunk->index, sizeof(chunk->index));
+    *hash = fnv1a(*hash, chunk->data, len);
+    w->dirty[count] = index;
+    return count + 1;
+}
+
+// Finds the chunks that differ from the start, in order, which become the
+// dirty ones, and hashes them with the registers. Returns the number of chunks.
+static int diff(worker* w, uint8_t* regs, uint64_t* hash) {
+    pack_regs(&w->cpu, regs);
+    uint64_t h = fnv1a(FNV_OFFSET, regs, REGS);
+    int count = 0;
+
+    for (int word = 0; word < MEM_CHUNKS / 64; word++) {
+        for (uint64_t bits = w->touched[word]; bits != 0; bits &= bits - 1) {
+            count = diff_chunk(w, word * 64 + __builtin_ctzll(bits), count, &h);
+        }
+        w->touched[word] = 0;
+    }
+    for (int i = MEM_CHUNKS; i < (int) CHUNKS; i++) {
+        count = diff_chunk(w, i, count, &h);
+    }
+
+    w->dirty_count = count;
+    *hash = h;
+    return count;
+}
+
+// Gives a newly visited state a node. Returns NO_NODE if there is no room.
+static uint32_t add_node(search* s, uint32_t parent, uint16_t keys) {
+    uint32_t node = atomic_fetch_add_explicit(&s->nodes, 1, memory_order_relaxed);
+    if (node >= s->opts->max_states) {
+        atomic_store(&s->full, 1);
+        atomic_store(&s->stop, 1);
+        return NO_NODE;
+    }
+    s->parents[node] = parent;
+    s->actions[node] = keys;
+    return node;
+}
+
+// Tries every action from a state, keeping the new states for the next level.
+static void expand(worker* w, packed* from) {
+    search* s = w->s;
+    const search_options* opts = s->opts;
+    buffer* out = &w->found[s->depth & 1];
+
+    for (int a = 0; a < opts->action_count && !atomic_load_explicit(&s->stop, memory_order_relaxed); a++) {
+        load(w, from);
+        run_step(w, opts->actions[a]);
+
+        uint8_t regs[REGS];
+        uint64_t hash;
+        int chunks = diff(w, regs, &hash);
+        if (!visit(s, hash)) {
+            continue;
+        }
+
+        uint32_t node = add_node(s, from->node, opts->actions[a]);
+        if (node == NO_NODE) {
+            return;
+        }
+
+        if (predicate_holds(opts->goal, w->c, &w->cpu)) {
+            uint32_t none = NO_NODE;
+            atomic_compare_exchange_strong(&s->goal, &none, node);
+            atomic_store(&s->stop, 1);
+            return;
+        }
+        if ((opts->prune != NULL && predicate_holds(opts->prune, w->c, &w->cpu)) || w->c->halted) {
+            continue;
+        }
+
+        packed* p = buffer_add(out, packed_size(chunks));
+        if (p == NULL) {
+            atomic_store(&s->full, 1);
+            atomic_store(&s->stop, 1);
+            return;
+        }
+        p->node = node;
+        p->chunks = chunks;
+        memcpy(p->regs, regs, REGS);
+        memcpy(packed_chunks(p), w->diff, chunks * sizeof(packed_chunk));
+    }
+
+    w->expanded++;
+}
+
+static void* worker_main(void* arg) {
+    worker* w = arg;
+    search* s = w->s;
+
+    while (!atomic_load_explicit(&s->stop, memory_order_relaxed)) {
+        uint64_t first = atomic_fetch_add_explicit(&s->next, BATCH, memory_order_relaxed);
+        if (first >= s->level_count) {
+            break;
+        }
+        uint64_t last = first + BATCH < s->level_count ? first + BATCH : s->level_count;
+        for (uint64_t i = first; i < last; i++) {
+            expand(w, s->level[i]);
+        }
+    }
+
+    return NULL;
+}
+
+// Lists the states the workers found for a level. Returns 0 if there is no memory for it.
+static int gather_level(search* s, int parity) {
+    uint64_t count = 0;
+    for (int t = 0; t < s->opts->threads; t++) {
+        buffer* b = &s->workers[t].found[parity];
+        for (size_t off = 0; off < b->len; off += packed_size(((packed*)(b->data + off))->chunks)) {
+            count++;
+        }
+    }
+
+    packed** level = realloc(s->level, (count > 0 ? count : 1) * sizeof(packed*));
+    if (level == NULL) {
+        return 0;
+    }
+    s->level = level;
+    s->level_count = 0;
+
+    for (int t = 0; t < s->opts->threads; t++) {
+        buffer* b = &s->workers[t].found[parity];
+        for (size_t off = 0; off < b->len; off += packed_size(((packed*)(b->data + off))->chunks)) {
+            s->level[s->level_count++] = (packed*)(b->data + off);
+        }
+    }
+    return 1;
+}
+
+// Walks back from the goal to the start to recover the keys held at each
+// step. Returns 0 if there is no memory for the path.
+static int trace_path(search* s, uint32_t node, search_result* result) {
+    int depth = 0;
+    for (uint32_t n = node; s->parents[n] != NO_NODE; n = s->parents[n]) {
+        depth++;
+    }
+
+    result->path = malloc((depth > 0 ? depth : 1) * sizeof(uint16_t));
+    if (result->path == NULL) {
+        return 0;
+    }
+    result->depth = depth;
+    for (uint32_t n = node; s->parents[n] != NO_NODE; n = s->parents[n]) {
+        result->path[--depth] = s->actions[n];
+    }
+    return 1;
+}
+
+// Frees everything search_run() set up. Works on a partly set up search.
+static void free_search(search* s, int threads, packed* first) {
+    if (s->workers != NULL) {
+        for (int t = 0; t < threads; t++) {
+            free(s->workers[t].found[0].data);
+            free(s->workers[t].found[1].data);
+            free(s->workers[t].diff);
+            free(s->workers[t].c);
+        }
+    }
+
+    free(first);
+    free(s->level);
+    free(s->workers);
+    free(s->actions);
+    free(s->parents);
+    free((void*) s->table);
+    free((void*) s->start);
+}
+
+// Searches breadth first from start until a state satisfies the goal, the
+// depth or state limit is reached, or there is nothing left to reach.
+// Returns 0 if there isn't memory for the search.
+int search_run(const snapshot* start, const search_options* opts, search_result* result) {
+    memset(result, 0, sizeof(*result));
+
+    search s = { .opts = opts };
+    uint64_t slots = 1;
+    while (slots < (uint64_t) opts->max_states * 2) {
+        slots <<= 1;
+    }
+    chip* base = malloc(sizeof(chip));
+    s.start = base;
+    s.table = calloc(slots, sizeof(uint64_t));
+    s.mask = slots - 1;
+    s.parents = malloc((size_t) opts->max_states * sizeof(uint32_t));
+    s.actions = malloc((size_t) opts->max_states * sizeof(uint16_t));
+    s.workers = calloc(opts->threads, sizeof(worker));
+    s.level = malloc(sizeof(packed*));
+    packed* first = malloc(sizeof(packed));
+    if (base == NULL || s.table == NULL || s.parents == NULL || s.actions == NULL || s.workers == NULL ||
+        s.level == NULL || first == NULL) {
+        free_search(&s, opts->threads, first);
+        return 0;
+    }
+    memcpy(base, &start->c, sizeof(chip));
+    base->keys = 0;
+    atomic_init(&s.goal, NO_NODE);
+
+    for (int t = 0; t < opts->threads; t++) {
+        worker* w = &s.workers[t];
+        w->s = &s;
+        w->c = malloc(sizeof(chip));
+        w->diff = malloc(CHUNKS * sizeof(packed_chunk));
+        if (w->c == NULL || w->diff == NULL) {
+            free_search(&s, opts->threads, first);
+            return 0;
+        }
+        memcpy(w->c, base, sizeof(chip));
+    }
+
+    // The start state is the first level, with nothing patched
+    first->node = 0;
+    first->chunks = 0;
+    pack_regs(&start->cpu, first->regs);
+    s.parents[0] = NO_NODE;
+    s.actions[0] = 0;
+    atomic_init(&s.nodes, 1);
+    s.level[0] = first;
+    s.level_count = 1;
+
+    uint64_t start_hash;
+    worker* w = &s.workers[0];
+    load(w, first);
+    diff(w, first->regs, &start_hash);
+    visit(&s, start_hash);
+    if (predicate_holds(opts->goal, w->c, &w->cpu)) {
+        atomic_store(&s.goal, 0);
+        atomic_store(&s.stop, 1);
+    }
+
+    for (s.depth = 1; s.depth <= opts->max_depth && s.level_count > 0 && !atomic_load(&s.stop); s.depth++) {
+        for (int t = 0; t < opts->threads; t++) {
+            s.workers[t].found[s.depth & 1].len = 0;
+        }
+        atomic_store(&s.next, 0);
+
+        for (int t = 1; t < opts->threads; t++) {
+            pthread_create(&s.workers[t].thread, NULL, worker_main, &s.workers[t]);
+        }
+        worker_main(&s.workers[0]);
+        for (int t = 1; t < opts->threads; t++) {
+            pthread_join(s.workers[t].thread, NULL);
+        }
+
+        if (!gather_level(&s, s.depth & 1)) {
+            atomic_store(&s.full, 1);
+            break;
+        }
+        if (opts->progress != NULL) {
+            uint32_t nodes = atomic_load(&s.nodes);
+            opts->progress(s.depth, nodes < opts->max_states ? nodes : opts->max_states, s.level_count);
+        }
+    }
+
+    uint32_t goal = atomic_load(&s.goal);
+    uint32_t nodes = atomic_load(&s.nodes);
+    result->found = goal != NO_NODE;
+    if (result->found && !trace_path(&s, goal, result)) {
+        free_search(&s, opts->threads, first);
+        return 0;
+    }
+    result->states = nodes < opts->max_states ? nodes : opts->max_states;
+    result->full = atomic_load(&s.full);
+    for (int t = 0; t < opts->threads; t++) {
+        result->expanded += s.workers[t].expanded;
+    }
+
+    free_search(&s, opts->threads, first);
+
+    return 1;
+}
@@ -0,0 +1,94 @@
+#include <inttypes.h>
+
+// Breadth-first search over keypad input. From a start state every step
+// holds one of a set of key masks for a few frames; states already reached
+// by a shorter input are dropped, so the first state that satisfies the
+// goal is reached by a shortest input.
+//
+// Visited states are kept only as 64-bit hashes in a lock-free table, and
+// each level of the search as compact states: the registers plus the
+// 64-byte chunks of the chip that differ from the start. Worker threads
+// share out every level. Hash collisions could in principle merge two
+// different states; at 64 bits that takes billions of states to matter.
+
+// Most conditions in a predicate
+#define MAX_CONDITIONS 16
+
+// Fields a condition can test
+#define FIELD_V   0 // a V register
+#define FIELD_I   1
+#define FIELD_PC  2
+#define FIELD_SP  3
+#define FIELD_DT  4
+#define FIELD_ST  5
+#define FIELD_MEM 6 // a byte of memory
+
+// Comparisons
+#define COMPARE_EQ 0
+#define COMPARE_NE 1
+#define COMPARE_LT 2
+#define COMPARE_LE 3
+#define COMPARE_GT 4
+#define COMPARE_GE 5
+
+typedef struct condition {
+    int field;
+
+    // Register number or memory address
+    uint16_t index;
+
+    int compare;
+    uint32_t value;
+} condition;
+
+// Conditions that must all hold, like "v3 == 5 && mem[0x3F0] >= 2"
+typedef struct predicate {
+    int count;
+    condition conditions[MAX_CONDITIONS];
+} predicate;
+
+typedef struct search_options {
+    // Key masks to choose from at every step
+    const uint16_t* actions;
+    int action_count;
+
+    // How long each step holds its keys
+    int frames_per_step;
+    int instructions_per_frame;
+
+    // Steps to go at most, and distinct states to visit at most
+    int max_depth;
+    uint32_t max_states;
+
+    int threads;
+
+    // States to stop at, and states not to search past (or NULL)
+    const predicate* goal;
+    const predicate* prune;
+
+    // Called after every level with the depth reached and the states so far, or NULL
+    void (*progress)(int depth, uint64_t states, uint64_t level_states);
+} search_options;
+
+typedef struct search_result {
+    // Set if a state satisfying the goal was reached
+    int found;
+
+    // Steps to reach it, and the keys held at each; path has depth entries
+    // and is the caller's to free
+    int depth;
+    uint16_t* path;
+
+    // Distinct states visited, and states run from (each tried with every action)
+    uint64_t states;
+    uint64_t expanded;
+
+    // Set if the search stopped because max_states was reached
+    int full;
+} search_result;
+
+struct snapshot;
+
+int parse_predicate(const char* text, predicate* p);
+int predicate_holds(const predicate* p, const chip* c, const CPU* cpu);
+int search_run(const struct snapshot* start, const search_options* opts, search_result* result);
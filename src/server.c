@@ -0,0 +1,493 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "cpu.h"
+#include "delta.h"
+#include "arena.h"
+#include "quirks.h"
+
+// Runs many independent sessions of one ROM for remote viewers:
+//   chip8-server [-u socket path | -p port] [-w workers] [-n max sessions]
+//                [-i instructions per frame] [-m chip8|schip|xochip] [-q quirks] rom
+//
+// Every connection gets its own session, starting from reset. Clients send
+// 3-byte key messages ('K' then the 16-bit keypad mask, little-endian) and
+// receive a frame message (see delta.h) for every 60Hz frame that changed the
+// screen. A client that can't keep up has frames coalesced: no new delta is
+// encoded until the previous one has been sent, so it always applies on top
+// of what the client has.
+//
+// The main thread runs the epoll loop (accepts, input and the frame timer);
+// worker threads run the sessions, each owning every Nth slot. Session slots
+// are allocated on first use and reused, so nothing is allocated per frame.
+// Machines come from an instance arena (see arena.h), so a session only
+// takes memory for what its ROM has changed.
+
+#define DEFAULT_PORT 8064
+#define DEFAULT_SESSIONS 1024
+#define INPUT_MESSAGE 3
+
+// epoll tags for the non-session descriptors
+#define TAG_LISTEN UINT32_MAX
+#define TAG_TIMER (UINT32_MAX - 1)
+
+// Slot states. The main thread moves FREE to ACTIVE on accept and ACTIVE to
+// CLOSING on disconnect; the owning worker closes the socket and moves
+// CLOSING back to FREE. Only the worker ever closes a session's socket.
+enum { SESSION_FREE, SESSION_ACTIVE, SESSION_CLOSING };
+
+typedef struct session {
+    _Atomic int state;
+    int fd;
+
+    // Latest keypad mask from the client, picked up at the start of each frame
+    _Atomic uint16_t keys;
+
+    // Emulator state, the slot's instance in the arena
+    chip* c;
+    CPU* cpu;
+
+    // What the client has been sent, and the frame being sent
+    screen_copy sent;
+    uint8_t* out;
+    size_t out_len;
+    size_t out_pos;
+
+    // Set by the worker once sending failed; the main thread sees the hangup
+    int dead;
+
+    // Partial input message (main thread only)
+    uint8_t in[INPUT_MESSAGE];
+    int in_len;
+} session;
+
+typedef struct server {
+    session* sessions;
+    int max_sessions;
+    int workers;
+    int instructions_per_frame;
+
+    // Machines for every slot, all starting from the loaded ROM
+    arena* instances;
+
+    // Frame clock, advanced by the main thread
+    pthread_mutex_t lock;
+    pthread_cond_t tick;
+    uint64_t frame;
+    int running;
+} server;
+
+typedef struct worker {
+    server* s;
+    int id;
+    pthread_t thread;
+} worker;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int sig) {
+    (void) sig;
+    stopping = 1;
+}
+
+// Sends as much of the pending frame as the socket takes without blocking.
+// Returns 0 once the connection has failed.
+static int flush_session(session* sess) {
+    while (sess->out_pos < sess->out_len) {
+        ssize_t n = send(sess->fd, sess->out + sess->out_pos, sess->out_len - sess->out_pos,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        sess->out_pos += n;
+    }
+    return 1;
+}
+
+// Runs one frame of a session and sends its screen changes.
+static void run_frame(server* s, session* sess) {
+    chip* c = sess->c;
+    CPU* cpu = sess->cpu;
+
+    c->keys = atomic_load_explicit(&sess->keys, memory_order_relaxed);
+    for (int i = 0; i < s->instructions_per_frame && !c->halted; i++) {
+        cycle(c, cpu);
+    }
+    if (cpu->dt > 0) {
+        cpu->dt--;
+    }
+    if (cpu->st > 0) {
+        cpu->st--;
+    }
+
+    // A slow client still has the last frame queued; changes go out with the next one
+    if (sess->out_pos == sess->out_len) {
+        sess->out_len = encode_delta(c, &sess->sent, sess->out);
+        sess->out_pos = 0;
+    }
+
+    if (!flush_session(sess)) {
+        // The hangup wakes the main thread, which hands the slot back for closing
+        sess->dead = 1;
+        shutdown(sess->fd, SHUT_RDWR);
+    }
+}
+
+static void* worker_main(void* arg) {
+    worker* w = arg;
+    server* s = w->s;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (s->running && s->frame == seen) {
+            pthread_cond_wait(&s->tick, &s->lock);
+        }
+        if (!s->running) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        seen = s->frame;
+        pthread_mutex_unlock(&s->lock);
+
+        for (int i = w->id; i < s->max_sessions; i += s->workers) {
+            session* sess = &s->sessions[i];
+            int state = atomic_load_explicit(&sess->state, memory_order_acquire);
+
+            if (state == SESSION_CLOSING) {
+                close(sess->fd);
+                arena_release(s->instances, i);
+                atomic_store_explicit(&sess->state, SESSION_FREE, memory_order_release);
+            } else if (state == SESSION_ACTIVE && !sess->dead) {
+                run_frame(s, sess);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Resets a free slot for a new connection. Returns 0 if it can't be allocated.
+static int open_session(server* s, session* sess, int fd) {
+    int slot = sess - s->sessions;
+    if (sess->out == NULL) {
+        sess->out = malloc(DELTA_MAX_MESSAGE);
+        if (sess->out == NULL) {
+            return 0;
+        }
+        sess->c = arena_chip(s->instances, slot);
+        sess->cpu = arena_cpu(s->instances, slot);
+    }
+    if (!arena_reset(s->instances, slot)) {
+        return 0;
+    }
+
+    memset(&sess->sent, 0, sizeof(sess->sent));
+    sess->out_len = 0;
+    sess->out_pos = 0;
+    sess->dead = 0;
+    sess->in_len = 0;
+    sess->fd = fd;
+    atomic_store_explicit(&sess->keys, 0, memory_order_relaxed);
+
+    atomic_store_explicit(&sess->state, SESSION_ACTIVE, memory_order_release);
+    return 1;
+}
+
+static void accept_sessions(server* s, int listen_fd, int epoll_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        int slot = -1;
+        for (int i = 0; i < s->max_sessions; i++) {
+            if (atomic_load_explicit(&s->sessions[i].state, memory_order_acquire) == SESSION_FREE) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0 || !open_session(s, &s->sessions[slot], fd)) {
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.u32 = slot };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            atomic_store_explicit(&s->sessions[slot].state, SESSION_CLOSING, memory_order_release);
+        }
+    }
+}
+
+// Reads key messages. Returns 0 once the client has gone or misbehaved.
+static int read_input(session* sess) {
+    uint8_t buf[64];
+
+    for (;;) {
+        ssize_t n = recv(sess->fd, buf, sizeof(buf), 0);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (sess->in_len == 0 && buf[i] != 'K') {
+                return 0;
+            }
+            sess->in[sess->in_len++] = buf[i];
+            if (sess->in_len == INPUT_MESSAGE) {
+                atomic_store_explicit(&sess->keys, sess->in[1] | sess->in[2] << 8, memory_order_relaxed);
+                sess->in_len = 0;
+            }
+        }
+    }
+}
+
+static int listen_unix(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_tcp(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    // Loopback only; put a proxy in front for remote viewers
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Thousands of sessions need more descriptors than the usual default of 1024
+static void raise_fd_limit(int wanted) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t) wanted) {
+        limit.rlim_cur = limit.rlim_max < (rlim_t) wanted ? limit.rlim_max : (rlim_t) wanted;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* socket_path = NULL;
+    int port = DEFAULT_PORT;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_sessions = DEFAULT_SESSIONS;
+    int instructions_per_frame = CPU_CLOCK_SPEED / FRAMES_PER_SECOND;
+    uint8_t mode = MODE_CHIP8;
+    int quirks = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u:p:w:n:i:m:q:")) != -1) {
+        switch (opt) {
+            case 'u':
+                socket_path = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            case 'n':
+                max_sessions = atoi(optarg);
+                break;
+            case 'i':
+                instructions_per_frame = atoi(optarg);
+                break;
+            case 'm':
+                if (strcmp(optarg, "schip") == 0) {
+                    mode = MODE_SCHIP;
+                } else if (strcmp(optarg, "xochip") == 0) {
+                    mode = MODE_XOCHIP;
+                } else if (strcmp(optarg, "chip8") != 0) {
+                    fprintf(stderr, "Unknown mode %s (chip8, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                quirks = parse_quirks(optarg);
+                if (quirks < 0) {
+                    fprintf(stderr, "Unknown quirk profile %s (modern, vip, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-u path | -p port] [-w workers] [-n sessions] "
+                                "[-i instructions per frame] [-m mode] [-q quirks] rom\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || workers < 1 || max_sessions < 1 || instructions_per_frame < 1) {
+        fprintf(stderr, "usage: %s [-u path | -p port] [-w workers] [-n sessions] "
+                        "[-i instructions per frame] [-m mode] [-q quirks] rom\n", argv[0]);
+        return 1;
+    }
+
+    FILE* rom = fopen(argv[optind], "rb");
+    if (rom == NULL) {
+        fprintf(stderr, "Can't open ROM %s\n", argv[optind]);
+        return 1;
+    }
+    fclose(rom);
+
+    server s = { 0 };
+    s.max_sessions = max_sessions;
+    s.workers = workers;
+    s.instructions_per_frame = instructions_per_frame;
+    s.running = 1;
+    chip* image = init();
+    image->mode = mode;
+    load_rom(image, argv[optind]);
+    image->quirks = quirks >= 0 ? quirks : select_quirks(argv[optind], mode);
+    CPU* reset_cpu = initialize();
+    s.instances = arena_create(image, reset_cpu, max_sessions);
+    free(reset_cpu);
+    free(image);
+    if (s.instances == NULL) {
+        fprintf(stderr, "Could not set up memory for %d sessions\n", max_sessions);
+        return 1;
+    }
+    s.sessions = calloc(max_sessions, sizeof(session));
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.tick, NULL);
+
+    raise_fd_limit(max_sessions + 16);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    int listen_fd = socket_path != NULL ? listen_unix(socket_path) : listen_tcp(port);
+    if (listen_fd < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec period = {
+        .it_interval = { 0, 1000000000 / FRAMES_PER_SECOND },
+        .it_value = { 0, 1000000000 / FRAMES_PER_SECOND },
+    };
+    timerfd_settime(timer_fd, 0, &period, NULL);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = TAG_LISTEN };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.u32 = TAG_TIMER;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+
+    worker* pool = calloc(workers, sizeof(worker));
+    for (int i = 0; i < workers; i++) {
+        pool[i].s = &s;
+        pool[i].id = i;
+        pthread_create(&pool[i].thread, NULL, worker_main, &pool[i]);
+    }
+
+    if (socket_path != NULL) {
+        printf("Serving %s on %s with %d workers\n", argv[optind], socket_path, workers);
+    } else {
+        printf("Serving %s on 127.0.0.1:%d with %d workers\n", argv[optind], port, workers);
+    }
+    fflush(stdout);
+
+    struct epoll_event events[256];
+    while (!stopping) {
+        int n = epoll_wait(epoll_fd, events, 256, -1);
+
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+
+            if (tag == TAG_LISTEN) {
+                accept_sessions(&s, listen_fd, epoll_fd);
+            } else if (tag == TAG_TIMER) {
+                // Workers that fall behind skip ahead rather than queueing up frames
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    pthread_mutex_lock(&s.lock);
+                    s.frame++;
+                    pthread_cond_broadcast(&s.tick);
+                    pthread_mutex_unlock(&s.lock);
+                }
+            } else {
+                session* sess = &s.sessions[tag];
+                if (atomic_load_explicit(&sess->state, memory_order_acquire) != SESSION_ACTIVE) {
+                    continue;
+                }
+                if ((events[i].events & (EPOLLHUP | EPOLLERR)) || !read_input(sess)) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sess->fd, NULL);
+                    atomic_store_explicit(&sess->state, SESSION_CLOSING, memory_order_release);
+                }
+            }
+        }
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.running = 0;
+    pthread_cond_broadcast(&s.tick);
+    pthread_mutex_unlock(&s.lock);
+    for (int i = 0; i < workers; i++) {
+        pthread_join(pool[i].thread, NULL);
+    }
+
+    for (int i = 0; i < max_sessions; i++) {
+        if (atomic_load(&s.sessions[i].state) != SESSION_FREE) {
+            close(s.sessions[i].fd);
+        }
+        free(s.sessions[i].out);
+    }
+    if (socket_path != NULL) {
+        unlink(socket_path);
+    }
+    close(epoll_fd);
+    close(timer_fd);
+    close(listen_fd);
+    free(pool);
+    free(s.sessions);
+    arena_destroy(s.instances);
+
+    return 0;
+}
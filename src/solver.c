@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "state.h"
+#include "quirks.h"
+#include "search.h"
+
+static struct timespec started;
+
+static double seconds_since(const struct timespec* from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - from->tv_sec) + (now.tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static void show_progress(int depth, uint64_t states, uint64_t level_states) {
+    double seconds = seconds_since(&started);
+    fprintf(stderr, "depth %d: %" PRIu64 " new states, %" PRIu64 " in all, %.0f per second\n",
+            depth, level_states, states, seconds > 0 ? states / seconds : 0);
+}
+
+// Reads actions as hex keypad digits, each one a step holding that key
+// alone, into actions with room for 17 (no keys, then each key once).
+// Returns the number of actions, or -1 if the list isn't valid.
+static int parse_actions(const char* keys, uint16_t* actions) {
+    uint16_t seen = 0;
+    int count = 0;
+    actions[count++] = 0;
+    for (const char* k = keys; *k != '\0'; k++) {
+        char digit[2] = {*k, '\0'};
+        char* end;
+        long key = strtol(digit, &end, 16);
+        if (*end != '\0' || (seen & (1 << key))) {
+            return -1;
+        }
+        seen |= 1 << key;
+        actions[count++] = 1 << key;
+    }
+    return count;
+}
+
+// Searches for the shortest input that takes a ROM to a goal state:
+//   chip8-search [-k keys] [-s frames per step] [-i instructions per frame] [-d depth]
+//                [-n max states] [-t threads] [-m mode] [-q quirks] [-x prune] -g goal rom
+// Goals and prune conditions look like "v3 == 5 && mem[0x3F0] >= 2" (see
+// search.h). Every step either holds one of the keys (default all 16) or
+// none. The input found is printed as "<frame> <hex keypad mask>" lines,
+// which chip8-check -k replays.
+int main(int argc, char** argv) {
+    uint16_t actions[17];
+    search_options opts = {
+        .actions = actions,
+        .action_count = parse_actions("0123456789ABCDEF", actions),
+        .frames_per_step = 4,
+        .instructions_per_frame = CPU_CLOCK_SPEED / FRAMES_PER_SECOND,
+        .max_depth = 1000,
+        .max_states = 1 << 23,
+        .threads = sysconf(_SC_NPROCESSORS_ONLN),
+        .progress = show_progress,
+    };
+    predicate goal;
+    predicate prune;
+    const char* goal_text = NULL;
+    uint8_t mode = MODE_CHIP8;
+    int quirks = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:s:i:d:n:t:m:q:x:g:")) != -1) {
+        switch (opt) {
+            case 'k':
+                opts.action_count = parse_actions(optarg, actions);
+                if (opts.action_count < 0) {
+                    fprintf(stderr, "Invalid keys %s (distinct hex digits)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                opts.frames_per_step = atoi(optarg);
+                break;
+            case 'i':
+                opts.instructions_per_frame = atoi(optarg);
+                break;
+            case 'd':
+                opts.max_depth = atoi(optarg);
+                break;
+            case 'n':
+                opts.max_states = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                opts.threads = atoi(optarg);
+                break;
+            case 'm':
+                if (strcmp(optarg, "schip") == 0) {
+                    mode = MODE_SCHIP;
+                } else if (strcmp(optarg, "xochip") == 0) {
+                    mode = MODE_XOCHIP;
+                } else if (strcmp(optarg, "chip8") != 0) {
+                    fprintf(stderr, "Unknown mode %s (chip8, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                quirks = parse_quirks(optarg);
+                if (quirks < 0) {
+                    fprintf(stderr, "Unknown quirk profile %s (modern, vip, schip or xochip)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'x':
+                if (!parse_predicate(optarg, &prune)) {
+                    fprintf(stderr, "Invalid prune condition %s\n", optarg);
+                    return 1;
+                }
+                opts.prune = &prune;
+                break;
+            case 'g':
+                if (!parse_predicate(optarg, &goal)) {
+                    fprintf(stderr, "Invalid goal %s\n", optarg);
+                    return 1;
+                }
+                goal_text = optarg;
+                opts.goal = &goal;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (optind != argc - 1 || goal_text == NULL || opts.frames_per_step < 1 || opts.instructions_per_frame < 1 ||
+        opts.max_states < 1 || opts.threads < 1) {
+        fprintf(stderr, "usage: %s [-k keys] [-s frames per step] [-i instructions per frame] [-d depth] "
+                        "[-n max states] [-t threads] [-m mode] [-q quirks] [-x prune] -g goal rom\n", argv[0]);
+        return 1;
+    }
+
+    FILE* f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open ROM %s\n", argv[optind]);
+        return 1;
+    }
+    fclose(f);
+
+    snapshot* start = malloc(sizeof(snapshot));
+    chip* c = init();
+    c->mode = mode;
+    load_rom(c, argv[optind]);
+    c->quirks = quirks >= 0 ? quirks : select_quirks(argv[optind], mode);
+    CPU* cpu = initialize();
+    snapshot_save(start, c, cpu);
+    free(cpu);
+    free(c);
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    search_result result;
+    if (!search_run(start, &opts, &result)) {
+        fprintf(stderr, "Could not set up a search of %u states\n", opts.max_states);
+        return 1;
+    }
+    double seconds = seconds_since(&started);
+
+    fprintf(stderr, "%" PRIu64 " states, %" PRIu64 " run from, in %.2f s with %d threads\n",
+            result.states, result.expanded, seconds, opts.threads);
+    if (!result.found) {
+        fprintf(stderr, "%s not reached%s\n", goal_text, result.full ? " before running out of room (see -n)" : "");
+        free(start);
+        return 1;
+    }
+
+    // Only changes of keys need a line; the last step is followed by a release
+    printf("# %s after %d steps of %d frames at %d instructions per frame\n",
+           goal_text, result.depth, opts.frames_per_step, opts.instructions_per_frame);
+    uint16_t held = 0;
+    for (int step = 0; step < result.depth; step++) {
+        if (result.path[step] != held) {
+            printf("%d %04X\n", step * opts.frames_per_step, result.path[step]);
+            held = result.path[step];
+        }
+    }
+    if (held != 0) {
+        printf("%d 0000\n", result.depth * opts.frames_per_step);
+    }
+
+    free(result.path);
+    free(start);
+
+    return 0;
+}
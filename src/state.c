@@ -0,0 +1,143 @@
+#include <string.h>
+#include "cpu.h"
+#include "state.h"
+
+// Hashes a buffer 8 bytes at a time (FNV-1a over 64-bit words rather than
+// bytes), which is 8 times fewer multiplies over the 64KB of memory. A
+// multiply only carries upward, so the high half is folded back in after
+// each word; otherwise the top bits of a word would never reach the low
+// bits of the hash.
+uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    const uint8_t* p = data;
+
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        hash = (hash ^ word) * FNV_PRIME;
+        hash ^= hash >> 32;
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        hash = (hash ^ *p++) * FNV_PRIME;
+        len--;
+    }
+
+    return hash;
+}
+
+// Hashes all of the emulated state. Fields are hashed one by one, so struct
+// padding never leaks into the result.
+uint64_t state_hash(chip* c, CPU* cpu) {
+    uint64_t hash = FNV_OFFSET;
+
+    uint8_t regs[27];
+    memcpy(regs, cpu->v, 16);
+    regs[16] = cpu->address & 0xFF;
+    regs[17] = cpu->address >> 8;
+    regs[18] = cpu->pc & 0xFF;
+    regs[19] = cpu->pc >> 8;
+    regs[20] = cpu->sp;
+    regs[21] = cpu->dt;
+    regs[22] = cpu->st;
+    memcpy(regs + 23, &cpu->rng, sizeof(cpu->rng));
+    hash = fnv1a(hash, regs, sizeof(regs));
+
+    hash = fnv1a(hash, c->mem, sizeof(c->mem));
+    hash = fnv1a(hash, c->game_screen, sizeof(c->game_screen));
+    hash = fnv1a(hash, c->stack, sizeof(c->stack));
+
+    uint8_t misc[9] = {c->mode, c->hires, c->planes, c->halted, c->pitch, c->keys & 0xFF, c->keys >> 8, c->key_pressed,
+                       c->fault};
+    hash = fnv1a(hash, misc, sizeof(misc));
+    hash = fnv1a(hash, c->rpl, sizeof(c->rpl));
+    hash = fnv1a(hash, c->audio, sizeof(c->audio));
+
+    return hash;
+}
+
+// Hashes what is on screen: the bitplanes and the resolution.
+uint64_t screen_hash(chip* c) {
+    uint64_t hash = fnv1a(FNV_OFFSET, c->game_screen, sizeof(c->game_screen));
+    return fnv1a(hash, &c->hires, 1);
+}
+
+void snapshot_save(snapshot* s, chip* c, CPU* cpu) {
+    memcpy(&s->c, c, sizeof(chip));
+    s->cpu = *cpu;
+}
+
+void snapshot_restore(const snapshot* s, chip* c, CPU* cpu) {
+    memcpy(c, &s->c, sizeof(chip));
+    *cpu = s->cpu;
+}
+
+static int dump_bytes(FILE* out, const char* name, const uint8_t* a, const uint8_t* b, int len, int limit) {
+    int shown = 0;
+    for (int i = 0; i < len; i++) {
+        if (a[i] != b[i]) {
+            if (shown++ < limit) {
+                fprintf(out, "  %s[%04X]  %02X  %02X\n", name, i, a[i], b[i]);
+            }
+        }
+    }
+    if (shown > limit) {
+        fprintf(out, "  ... %d more differences in %s\n", shown - limit, name);
+    }
+    return shown;
+}
+
+// Prints the registers of both states side by side, marking differences,
+// followed by any differing memory, stack and screen rows. Returns the
+// number of differences.
+int state_dump_diff(FILE* out, const snapshot* a, const snapshot* b) {
+    int diffs = 0;
+
+    fprintf(out, "  %-8s  %-4s  %-4s\n", "", "A", "B");
+    for (int i = 0; i < 16; i++) {
+        int differ = a->cpu.v[i] != b->cpu.v[i];
+        diffs += differ;
+        fprintf(out, "  V%-7X  %02X    %02X   %s\n", i, a->cpu.v[i], b->cpu.v[i], differ ? "<--" : "");
+    }
+
+    const char* names[5] = {"I", "PC", "SP", "DT", "ST"};
+    int values_a[5] = {a->cpu.address, a->cpu.pc, a->cpu.sp, a->cpu.dt, a->cpu.st};
+    int values_b[5] = {b->cpu.address, b->cpu.pc, b->cpu.sp, b->cpu.dt, b->cpu.st};
+    for (int i = 0; i < 5; i++) {
+        int differ = values_a[i] != values_b[i];
+        diffs += differ;
+        fprintf(out, "  %-8s  %04X  %04X %s\n", names[i], values_a[i], values_b[i], differ ? "<--" : "");
+    }
+    if (a->cpu.rng != b->cpu.rng) {
+        diffs++;
+        fprintf(out, "  RNG       %08X  %08X <--\n", a->cpu.rng, b->cpu.rng);
+    }
+
+    diffs += dump_bytes(out, "mem", a->c.mem, b->c.mem, EMU_MEMORY, 16);
+    diffs += dump_bytes(out, "stack", (const uint8_t*) a->c.stack, (const uint8_t*) b->c.stack, sizeof(a->c.stack), 8);
+
+    for (int p = 0; p < SCREEN_PLANES; p++) {
+        for (int y = 0; y < HIRES_HEIGHT; y++) {
+            for (int w = 0; w < SCREEN_WORDS; w++) {
+                if (a->c.game_screen[p][y][w] != b->c.game_screen[p][y][w]) {
+                    diffs++;
+                    fprintf(out, "  plane %d row %2d word %d  %016" PRIX64 "  %016" PRIX64 "\n", p, y, w,
+                            a->c.game_screen[p][y][w], b->c.game_screen[p][y][w]);
+                }
+            }
+        }
+    }
+
+    if (a->c.mode != b->c.mode || a->c.hires != b->c.hires || a->c.planes != b->c.planes ||
+        a->c.halted != b->c.halted || a->c.keys != b->c.keys || a->c.key_pressed != b->c.key_pressed ||
+        a->c.pitch != b->c.pitch || a->c.fault != b->c.fault) {
+        diffs++;
+        fprintf(out, "  mode/hires/planes/halted/keys/key_pressed/pitch/fault  %d/%d/%d/%d/%04X/%d/%d/%d  %d/%d/%d/%d/%04X/%d/%d/%d\n",
+                a->c.mode, a->c.hires, a->c.planes, a->c.halted, a->c.keys, a->c.key_pressed, a->c.pitch, a->c.fault,
+                b->c.mode, b->c.hires, b->c.planes, b->c.halted, b->c.keys, b->c.key_pressed, b->c.pitch, b->c.fault);
+    }
+    diffs += dump_bytes(out, "rpl", a->c.rpl, b->c.rpl, sizeof(a->c.rpl), 16);
+    diffs += dump_bytes(out, "audio", a->c.audio, b->c.audio, sizeof(a->c.audio), 16);
+
+    return diffs;
+}
@@ -0,0 +1,19 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+// A complete copy of an emulated machine.
+typedef struct snapshot {
+    chip c;
+    CPU cpu;
+} snapshot;
+
+// 64-bit FNV-1a
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+uint64_t fnv1a(uint64_t hash, const void* data, size_t len);
+uint64_t state_hash(chip* c, CPU* cpu);
+uint64_t screen_hash(chip* c);
+void snapshot_save(snapshot* s, chip* c, CPU* cpu);
+void snapshot_restore(const snapshot* s, chip* c, CPU* cpu);
+int state_dump_diff(FILE* out, const snapshot* a, const snapshot* b);
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "stats.h"
+
+struct stats {
+    stats_segment* seg;
+    char name[32];
+};
+
+static void segment_name(char* name, int pid) {
+    sprintf(name, "/chip8-%d", pid);
+}
+
+// Creates and maps this process's stats segment. Returns NULL on failure.
+stats* stats_create(const char* rom) {
+    stats* s = calloc(1, sizeof(stats));
+    if (s == NULL) {
+        return NULL;
+    }
+
+    segment_name(s->name, getpid());
+    int fd = shm_open(s->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(s);
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(stats_segment)) != 0) {
+        close(fd);
+        shm_unlink(s->name);
+        free(s);
+        return NULL;
+    }
+
+    s->seg = mmap(NULL, sizeof(stats_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s->seg == MAP_FAILED) {
+        shm_unlink(s->name);
+        free(s);
+        return NULL;
+    }
+
+    // The segment starts zeroed; fill in the header last so readers never see a half-initialized one
+    s->seg->version = STATS_VERSION;
+    s->seg->pid = getpid();
+    strncpy(s->seg->rom, rom, sizeof(s->seg->rom) - 1);
+    atomic_thread_fence(memory_order_release);
+    memcpy(s->seg->magic, STATS_MAGIC, sizeof(s->seg->magic));
+
+    return s;
+}
+
+// Publishes one frame's worth of counters. This only writes to the shared
+// mapping (plus a vDSO clock read), so it never enters the kernel.
+void stats_frame(stats* s, uint64_t instructions, uint32_t draw_calls, uint64_t frame_ns,
+                 uint64_t sleep_overshoot_ns, uint32_t sleeps) {
+    stats_segment* seg = s->seg;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    uint64_t bucket = frame_ns / 1000 / STATS_BUCKET_US;
+    if (bucket >= STATS_BUCKETS) {
+        bucket = STATS_BUCKETS - 1;
+    }
+
+    uint32_t seq = atomic_load_explicit(&seg->seq, memory_order_relaxed);
+    atomic_store_explicit(&seg->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    seg->updated_ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    seg->instructions += instructions;
+    seg->frames++;
+    seg->draw_calls += draw_calls;
+    seg->sleep_overshoot_ns += sleep_overshoot_ns;
+    seg->sleep_count += sleeps;
+    seg->last_frame_draw_calls = draw_calls;
+    seg->frame_time[bucket]++;
+
+    atomic_store_explicit(&seg->seq, seq + 2, memory_order_release);
+}
+
+void stats_destroy(stats* s) {
+    munmap(s->seg, sizeof(stats_segment));
+    shm_unlink(s->name);
+    free(s);
+}
+
+// Maps another process's stats segment read-only. Returns NULL if it has none.
+stats_segment* stats_map(int pid) {
+    char name[32];
+    segment_name(name, pid);
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    stats_segment* seg = mmap(NULL, sizeof(stats_segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (memcmp(seg->magic, STATS_MAGIC, sizeof(seg->magic)) != 0 || seg->version != STATS_VERSION) {
+        munmap(seg, sizeof(stats_segment));
+        return NULL;
+    }
+
+    return seg;
+}
+
+// Takes a consistent copy of the segment, retrying while the emulator is mid-update.
+void stats_snapshot(stats_segment* seg, stats_segment* out) {
+    for (;;) {
+        uint32_t before = atomic_load_explicit(&seg->seq, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        memcpy(out, seg, sizeof(stats_segment));
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&seg->seq, memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+void stats_unmap(stats_segment* seg) {
+    munmap(seg, sizeof(stats_segment));
+}
+
+// Returns the frame time in milliseconds at percentile p (0 to 100) of a
+// histogram, using the upper edge of the bucket. Returns 0 for an empty histogram.
+double stats_percentile(const uint32_t* hist, double p) {
+    uint64_t total = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        total += hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(total * p / 100.0);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= target) {
+            return (i + 1) * STATS_BUCKET_US / 1000.0;
+        }
+    }
+
+    return STATS_BUCKETS * STATS_BUCKET_US / 1000.0;
+}
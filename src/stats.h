@@ -0,0 +1,51 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+
+// Each running emulator publishes its counters in a shared memory segment
+// named /chip8-<pid> (visible under /dev/shm), read by chip8-stat.
+#define STATS_MAGIC "CH8STAT"
+#define STATS_VERSION 1
+
+// Frame time histogram: 100us buckets, the last one collecting everything slower
+#define STATS_BUCKET_US 100
+#define STATS_BUCKETS 512
+
+typedef struct stats_segment {
+    char magic[8];
+    uint32_t version;
+    int32_t pid;
+    char rom[64];
+
+    // Seqlock: odd while the emulator is updating the counters below
+    _Atomic uint32_t seq;
+
+    // Wall clock time of the last update, in nanoseconds
+    uint64_t updated_ns;
+
+    // Running totals
+    uint64_t instructions;
+    uint64_t frames;
+    uint64_t draw_calls;
+    uint64_t sleep_overshoot_ns;
+    uint64_t sleep_count;
+
+    // Draw calls during the most recent frame
+    uint32_t last_frame_draw_calls;
+
+    // Frame time histogram
+    uint32_t frame_time[STATS_BUCKETS];
+} stats_segment;
+
+typedef struct stats stats;
+
+// Publishing (emulator side)
+stats* stats_create(const char* rom);
+void stats_frame(stats* s, uint64_t instructions, uint32_t draw_calls, uint64_t frame_ns,
+                 uint64_t sleep_overshoot_ns, uint32_t sleeps);
+void stats_destroy(stats* s);
+
+// Reading (chip8-stat side)
+stats_segment* stats_map(int pid);
+void stats_snapshot(stats_segment* seg, stats_segment* out);
+void stats_unmap(stats_segment* seg);
+double stats_percentile(const uint32_t* hist, double p);
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "stats.h"
+
+#define MAX_INSTANCES 256
+
+// Prints live counters of running emulators, similar to vmstat:
+//   chip8-stat [-c] [-n count] [interval seconds] [pid...]
+// Without pids, every emulator publishing stats is shown. -c prints CSV.
+int main(int argc, char** argv) {
+    int csv = 0;
+    long count = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "cn:")) != -1) {
+        switch (opt) {
+            case 'c':
+                csv = 1;
+                break;
+            case 'n':
+                count = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c] [-n count] [interval] [pid...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    double interval = 1;
+    if (optind < argc) {
+        interval = atof(argv[optind++]);
+    }
+
+    // Find the segments to watch
+    int pids[MAX_INSTANCES];
+    int num_pids = 0;
+    if (optind < argc) {
+        while (optind < argc && num_pids < MAX_INSTANCES) {
+            pids[num_pids++] = atoi(argv[optind++]);
+        }
+    } else {
+        DIR* dir = opendir("/dev/shm");
+        struct dirent* entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL && num_pids < MAX_INSTANCES) {
+            if (strncmp(entry->d_name, "chip8-", 6) == 0) {
+                pids[num_pids++] = atoi(entry->d_name + 6);
+            }
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+    }
+
+    stats_segment* segs[MAX_INSTANCES];
+    stats_segment* prev = calloc(MAX_INSTANCES, sizeof(stats_segment));
+    stats_segment cur;
+    int num_segs = 0;
+    for (int i = 0; i < num_pids; i++) {
+        segs[num_segs] = stats_map(pids[i]);
+        if (segs[num_segs] != NULL) {
+            stats_snapshot(segs[num_segs], &prev[num_segs]);
+            num_segs++;
+        }
+    }
+    if (num_segs == 0) {
+        fprintf(stderr, "No running emulators publish stats (start chip8 with -s)\n");
+        return 1;
+    }
+
+    if (csv) {
+        printf("pid,instructions_per_sec,frames_per_sec,frame_p50_ms,frame_p90_ms,frame_p99_ms,sleep_overshoot_us,draws_per_frame\n");
+    } else {
+        printf("%7s %12s %7s %8s %8s %8s %10s %11s  %s\n",
+               "pid", "instr/s", "fps", "p50 ms", "p90 ms", "p99 ms", "oversleep", "draws/frame", "rom");
+    }
+
+    for (long n = 0; count < 0 || n < count; n++) {
+        usleep(interval * 1000000);
+
+        for (int i = 0; i < num_segs; i++) {
+            stats_snapshot(segs[i], &cur);
+
+            double elapsed = (cur.updated_ns - prev[i].updated_ns) / 1e9;
+            uint64_t frames = cur.frames - prev[i].frames;
+
+            // Only this interval's frame times
+            uint32_t hist[STATS_BUCKETS];
+            for (int b = 0; b < STATS_BUCKETS; b++) {
+                hist[b] = cur.frame_time[b] - prev[i].frame_time[b];
+            }
+
+            double ips = elapsed > 0 ? (cur.instructions - prev[i].instructions) / elapsed : 0;
+            double fps = elapsed > 0 ? frames / elapsed : 0;
+            uint64_t sleeps = cur.sleep_count - prev[i].sleep_count;
+            double overshoot = sleeps > 0 ? (cur.sleep_overshoot_ns - prev[i].sleep_overshoot_ns) / 1000.0 / sleeps : 0;
+            double draws = frames > 0 ? (double)(cur.draw_calls - prev[i].draw_calls) / frames : 0;
+
+            if (csv) {
+                printf("%d,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f\n", cur.pid, ips, fps,
+                       stats_percentile(hist, 50), stats_percentile(hist, 90), stats_percentile(hist, 99),
+                       overshoot, draws);
+            } else {
+                printf("%7d %12.0f %7.1f %8.1f %8.1f %8.1f %8.1fus %11.2f  %s\n", cur.pid, ips, fps,
+                       stats_percentile(hist, 50), stats_percentile(hist, 90), stats_percentile(hist, 99),
+                       overshoot, draws, cur.rom);
+            }
+
+            prev[i] = cur;
+        }
+        fflush(stdout);
+    }
+
+    for (int i = 0; i < num_segs; i++) {
+        stats_unmap(segs[i]);
+    }
+    free(prev);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <string.h>
+#include "cpu.h"
+#include "timing.h"
+
+// The fixed model keeps the old behaviour of a set number of instructions
+// per frame; the VIP model ignores it.
+void clock_init(emu_clock* t, int model, uint32_t instructions_per_frame) {
+    t->model = model;
+    t->frame_cycles = model == TIMING_VIP ? VIP_FRAME_CYCLES - VIP_DISPLAY_CYCLES : instructions_per_frame;
+    t->elapsed = 0;
+    t->frames = 0;
+}
+
+// Returns the TIMING_* value for a model name, or -1.
+int parse_timing(const char* name) {
+    if (strcmp(name, "fixed") == 0) {
+        return TIMING_FIXED;
+    }
+    if (strcmp(name, "vip") == 0) {
+        return TIMING_VIP;
+    }
+    return -1;
+}
+
+// Machine cycles the COSMAC VIP interpreter spends on an instruction, on
+// top of fetching and decoding it. These are approximations from published
+// analyses of the interpreter, rounded and without the data dependent parts
+// (sprite alignment, BCD digits). Skips take 4 more when taken.
+static uint32_t vip_cycles(uint16_t data, int skipped) {
+    int x = (data & 0x0F00) >> 8;
+    int n = data & 0x000F;
+
+    switch (data & 0xF000) {
+        case 0x0000:
+            return data == 0x00E0 ? 24 : data == 0x00EE ? 10 : 20;
+        case 0x1000:
+            return 12;
+        case 0x2000:
+            return 26;
+        case 0x3000:
+        case 0x4000:
+            return skipped ? 14 : 10;
+        case 0x5000:
+        case 0x9000:
+            return skipped ? 18 : 14;
+        case 0x6000:
+            return 6;
+        case 0x7000:
+            return 10;
+        case 0x8000:
+            return 44;
+        case 0xA000:
+            return 12;
+        case 0xB000:
+            return 22;
+        case 0xC000:
+            return 36;
+        case 0xD000:
+            return 26 + n * 46;
+        case 0xE000:
+            return skipped ? 18 : 14;
+    }
+
+    switch (data & 0xF0FF) {
+        case 0xF01E:
+        case 0xF029:
+            return 16;
+        case 0xF033:
+            return 100;
+        case 0xF055:
+        case 0xF065:
+            return 14 + 14 * (x + 1);
+    }
+    return 10;
+}
+
+// Fetching and decoding an instruction on the VIP
+#define VIP_FETCH_CYCLES 40
+
+uint32_t instruction_cycles(int model, uint16_t data, int skipped) {
+    if (model == TIMING_VIP) {
+        return VIP_FETCH_CYCLES + vip_cycles(data, skipped);
+    }
+    return 1;
+}
+
+// Ends the current frame: the timers count down at the frame boundary.
+static void end_frame(emu_clock* t, CPU* cpu) {
+    if (cpu->dt > 0) {
+        cpu->dt--;
+    }
+    if (cpu->st > 0) {
+        cpu->st--;
+    }
+    t->frames++;
+}
+
+// Charges the instruction data, fetched from pc, that just ran. Returns the
+// number of frames it completed, usually 0 or 1.
+int clock_step(emu_clock* t, CPU* cpu, uint16_t pc, uint16_t data) {
+    // Only matters for the conditional skips, which otherwise go to the next instruction
+    int skipped = cpu->pc != (uint16_t)(pc + 2);
+    uint32_t cost = instruction_cycles(t->model, data, skipped);
+    int frames = 0;
+
+    // On the VIP a draw first waits for the display interrupt, so the rest of
+    // the frame goes by idle and the draw itself happens in the next one
+    if (t->model == TIMING_VIP && (data & 0xF000) == 0xD000) {
+        end_frame(t, cpu);
+        t->elapsed = 0;
+        frames++;
+    }
+
+    t->elapsed += cost;
+    while (t->elapsed >= t->frame_cycles) {
+        t->elapsed -= t->frame_cycles;
+        end_frame(t, cpu);
+        frames++;
+    }
+
+    return frames;
+}
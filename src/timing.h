@@ -0,0 +1,35 @@
+#include <inttypes.h>
+
+// Emulated time. Every instruction is charged a number of cycles and the
+// delay and sound timers tick each time a frame's worth of cycles has gone
+// by, so they depend only on what the program executed and never on the
+// host. Frontends decide how emulated frames map to wall time.
+#define TIMING_FIXED 0 // every instruction is one cycle
+#define TIMING_VIP   1 // COSMAC VIP machine cycles, with Dxyn waiting for vblank
+
+// COSMAC VIP machine cycles (8 clocks of the 1.76 MHz CDP1802) per 60 Hz
+// frame, and roughly how many of them the CDP1861 display DMA and its
+// interrupt routine take away from the interpreter
+#define VIP_FRAME_CYCLES 3668
+#define VIP_DISPLAY_CYCLES 1100
+
+struct CPU;
+
+typedef struct emu_clock {
+    // One of the TIMING_* models
+    int model;
+
+    // Cycles the interpreter gets per frame
+    uint32_t frame_cycles;
+
+    // Cycles spent so far in the current frame
+    uint32_t elapsed;
+
+    // Frames completed since the start
+    uint64_t frames;
+} emu_clock;
+
+void clock_init(emu_clock* t, int model, uint32_t instructions_per_frame);
+int parse_timing(const char* name);
+uint32_t instruction_cycles(int model, uint16_t data, int skipped);
+int clock_step(emu_clock* t, struct CPU* cpu, uint16_t pc, uint16_t data);
@@ -0,0 +1,369 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "cpu.h"
+#include "trace.h"
+
+struct trace {
+    gzFile out;
+    pthread_t writer;
+    atomic_int running;
+
+    // Set by the writer once the file can't be written; recording stops
+    atomic_int failed;
+
+    // Single-producer/single-consumer byte ring. head and tail are
+    // monotonically increasing byte counts; only the emulator thread writes
+    // head and only the writer thread writes tail.
+    uint8_t* ring;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+
+    // Producer-side cache of tail, so the emulator only touches the shared
+    // cache line when the ring looks full.
+    uint64_t tail_cache;
+
+    // State as of the last record, used to compute deltas
+    CPU shadow;
+    int has_shadow;
+
+    uint64_t records;
+};
+
+struct trace_reader {
+    gzFile in;
+    CPU state;
+};
+
+// Drains the ring into the compressed stream until tracing stops.
+static void* trace_writer(void* arg) {
+    trace* t = arg;
+
+    for (;;) {
+        int running = atomic_load_explicit(&t->running, memory_order_acquire);
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+
+        if (head == tail) {
+            if (!running) {
+                break;
+            }
+            usleep(1000);
+            continue;
+        }
+
+        // Write out the contiguous part of the pending bytes
+        uint64_t start = tail & (TRACE_RING_SIZE - 1);
+        uint64_t len = head - tail;
+        if (start + len > TRACE_RING_SIZE) {
+            len = TRACE_RING_SIZE - start;
+        }
+        if (!atomic_load_explicit(&t->failed, memory_order_relaxed) &&
+            gzwrite(t->out, t->ring + start, (unsigned) len) != (int) len) {
+            int err;
+            fprintf(stderr, "Trace write failed (%s), tracing stopped\n", gzerror(t->out, &err));
+            atomic_store_explicit(&t->failed, 1, memory_order_relaxed);
+        }
+
+        atomic_store_explicit(&t->tail, tail + len, memory_order_release);
+    }
+
+    return NULL;
+}
+
+// Opens a trace file and starts its background writer. Returns NULL on failure.
+trace* trace_open(const char* filename) {
+    trace* t = calloc(1, sizeof(trace));
+    if (t == NULL) {
+        return NULL;
+    }
+
+    t->ring = malloc(TRACE_RING_SIZE);
+    t->out = gzopen(filename, "wb1");
+    if (t->ring == NULL || t->out == NULL) {
+        free(t->ring);
+        free(t);
+        return NULL;
+    }
+
+    // The header goes straight into the stream; the writer is not running yet
+    uint8_t header[5] = {TRACE_MAGIC[0], TRACE_MAGIC[1], TRACE_MAGIC[2], TRACE_MAGIC[3], TRACE_VERSION};
+    if (gzwrite(t->out, header, sizeof(header)) != sizeof(header)) {
+        gzclose(t->out);
+        free(t->ring);
+        free(t);
+        return NULL;
+    }
+
+    atomic_store(&t->running, 1);
+    if (pthread_create(&t->writer, NULL, trace_writer, t) != 0) {
+        gzclose(t->out);
+        free(t->ring);
+        free(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+// Copies an encoded record into the ring, waiting for the writer if the ring is full.
+static void trace_put(trace* t, const uint8_t* buf, int len) {
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+
+    while (head + len - t->tail_cache > TRACE_RING_SIZE) {
+        t->tail_cache = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if (head + len - t->tail_cache > TRACE_RING_SIZE) {
+            sched_yield();
+        }
+    }
+
+    uint64_t start = head & (TRACE_RING_SIZE - 1);
+    uint64_t first = TRACE_RING_SIZE - start;
+    if (first >= (uint64_t) len) {
+        memcpy(t->ring + start, buf, len);
+    } else {
+        memcpy(t->ring + start, buf, first);
+        memcpy(t->ring, buf + first, len - first);
+    }
+
+    atomic_store_explicit(&t->head, head + len, memory_order_release);
+}
+
+// Appends a TRACE_MEM block for count bytes of memory from address.
+static int put_mem(uint8_t* buf, int len, const chip* c, uint16_t address, int count, uint8_t more) {
+    buf[len++] = address >> 8;
+    buf[len++] = address & 0xFF;
+    buf[len++] = count | more;
+    memcpy(buf + len, &c->mem[address], count);
+    return len + count;
+}
+
+// Runs a single CPU cycle and records the instruction along with every
+// register and memory change it made. Once the trace can't be written
+// the cycle still runs but nothing more is recorded.
+uint16_t trace_cycle(trace* t, chip* c, CPU* cpu) {
+    if (atomic_load_explicit(&t->failed, memory_order_relaxed)) {
+        return cycle(c, cpu);
+    }
+
+    uint16_t pc = cpu->pc;
+    uint16_t address = cpu->address;
+    uint16_t data = (uint16_t)(c->mem[pc] << 8 | c->mem[(uint16_t)(pc + 1)]);
+
+    uint16_t opcode = cycle(c, cpu);
+
+    uint8_t buf[TRACE_MAX_RECORD];
+    int len = 1;
+    uint8_t flags = 0;
+    CPU* prev = &t->shadow;
+
+    if (!t->has_shadow || prev->pc != pc) {
+        flags |= TRACE_PC;
+        buf[len++] = pc >> 8;
+        buf[len++] = pc & 0xFF;
+    }
+
+    buf[len++] = data >> 8;
+    buf[len++] = data & 0xFF;
+
+    // Changed V registers
+    uint16_t mask = 0;
+    for (int i = 0; i < 16; i++) {
+        if (!t->has_shadow || cpu->v[i] != prev->v[i]) {
+            mask |= 1 << i;
+        }
+    }
+    if (mask) {
+        flags |= TRACE_REGS;
+        buf[len++] = mask >> 8;
+        buf[len++] = mask & 0xFF;
+        for (int i = 0; i < 16; i++) {
+            if (mask & (1 << i)) {
+                buf[len++] = cpu->v[i];
+            }
+        }
+    }
+
+    if (!t->has_shadow || cpu->address != prev->address) {
+        flags |= TRACE_I;
+        buf[len++] = cpu->address >> 8;
+        buf[len++] = cpu->address & 0xFF;
+    }
+    if (!t->has_shadow || cpu->sp != prev->sp) {
+        flags |= TRACE_SP;
+        buf[len++] = cpu->sp;
+    }
+    if (!t->has_shadow || cpu->dt != prev->dt) {
+        flags |= TRACE_DT;
+        buf[len++] = cpu->dt;
+    }
+    if (!t->has_shadow || cpu->st != prev->st) {
+        flags |= TRACE_ST;
+        buf[len++] = cpu->st;
+    }
+
+    // Only Fx33, Fx55 and XO-CHIP's 5xy2 write to memory. A store that runs
+    // past the end of memory wraps to 0, so it's recorded in two parts.
+    int count = stored_bytes(data);
+    if (count > 0) {
+        flags |= TRACE_MEM;
+        if (address + count > EMU_MEMORY) {
+            int first = EMU_MEMORY - address;
+            len = put_mem(buf, len, c, address, first, TRACE_MEM_MORE);
+            len = put_mem(buf, len, c, 0, count - first, 0);
+        } else {
+            len = put_mem(buf, len, c, address, count, 0);
+        }
+    }
+
+    if (cpu->pc != (uint16_t)(pc + 2)) {
+        flags |= TRACE_JUMP;
+        buf[len++] = cpu->pc >> 8;
+        buf[len++] = cpu->pc & 0xFF;
+    }
+
+    buf[0] = flags;
+    trace_put(t, buf, len);
+
+    t->shadow = *cpu;
+    t->has_shadow = 1;
+    t->records++;
+
+    return opcode;
+}
+
+// Flushes all pending records, stops the writer and closes the file.
+// Returns the number of records written.
+uint64_t trace_close(trace* t) {
+    atomic_store_explicit(&t->running, 0, memory_order_release);
+    pthread_join(t->writer, NULL);
+
+    if (gzclose(t->out) != Z_OK && !atomic_load(&t->failed)) {
+        fprintf(stderr, "Trace write failed on close, the trace is incomplete\n");
+    }
+
+    uint64_t records = t->records;
+    free(t->ring);
+    free(t);
+
+    return records;
+}
+
+// Opens a trace file for reading. Returns NULL if it is not a valid trace.
+trace_reader* trace_reader_open(const char* filename) {
+    trace_reader* r = calloc(1, sizeof(trace_reader));
+    if (r == NULL) {
+        return NULL;
+    }
+
+    r->in = gzopen(filename, "rb");
+    uint8_t header[5];
+    if (r->in == NULL || gzread(r->in, header, sizeof(header)) != sizeof(header) ||
+        memcmp(header, TRACE_MAGIC, 4) != 0 || header[4] < 1 || header[4] > TRACE_VERSION) {
+        if (r->in != NULL) {
+            gzclose(r->in);
+        }
+        free(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+// Reads exactly len bytes; returns 0 at end of stream.
+static int trace_read(trace_reader* r, uint8_t* buf, int len) {
+    return gzread(r->in, buf, len) == len;
+}
+
+static int trace_read16(trace_reader* r, uint16_t* value) {
+    uint8_t buf[2];
+    if (!trace_read(r, buf, 2)) {
+        return 0;
+    }
+    *value = (uint16_t)(buf[0] << 8 | buf[1]);
+    return 1;
+}
+
+// Decodes the next record. Returns 1 on success and 0 at the end of the trace.
+int trace_reader_next(trace_reader* r, trace_record* rec) {
+    if (!trace_read(r, &rec->flags, 1)) {
+        return 0;
+    }
+
+    CPU* s = &r->state;
+    rec->pc = s->pc;
+    if (rec->flags & TRACE_PC && !trace_read16(r, &rec->pc)) {
+        return 0;
+    }
+    if (!trace_read16(r, &rec->opcode)) {
+        return 0;
+    }
+
+    rec->reg_mask = 0;
+    if (rec->flags & TRACE_REGS) {
+        if (!trace_read16(r, &rec->reg_mask)) {
+            return 0;
+        }
+        for (int i = 0; i < 16; i++) {
+            if (rec->reg_mask & (1 << i) && !trace_read(r, &s->v[i], 1)) {
+                return 0;
+            }
+        }
+    }
+    if (rec->flags & TRACE_I && !trace_read16(r, &s->address)) {
+        return 0;
+    }
+    if (rec->flags & TRACE_SP && !trace_read(r, &s->sp, 1)) {
+        return 0;
+    }
+    if (rec->flags & TRACE_DT && !trace_read(r, &s->dt, 1)) {
+        return 0;
+    }
+    if (rec->flags & TRACE_ST && !trace_read(r, &s->st, 1)) {
+        return 0;
+    }
+
+    rec->mem_count = 0;
+    if (rec->flags & TRACE_MEM) {
+        uint8_t count;
+        if (!trace_read16(r, &rec->mem_address) || !trace_read(r, &count, 1) ||
+            !trace_read(r, rec->mem, count & ~TRACE_MEM_MORE)) {
+            return 0;
+        }
+        rec->mem_count = count & ~TRACE_MEM_MORE;
+
+        // The part of a wrapped store written from address 0
+        uint16_t wrapped;
+        if (count & TRACE_MEM_MORE) {
+            if (!trace_read16(r, &wrapped) || !trace_read(r, &count, 1) ||
+                !trace_read(r, rec->mem + rec->mem_count, count)) {
+                return 0;
+            }
+            rec->mem_count += count;
+        }
+    }
+
+    rec->next_pc = rec->pc + 2;
+    if (rec->flags & TRACE_JUMP && !trace_read16(r, &rec->next_pc)) {
+        return 0;
+    }
+    s->pc = rec->next_pc;
+
+    memcpy(rec->v, s->v, sizeof(rec->v));
+    rec->address = s->address;
+    rec->sp = s->sp;
+    rec->dt = s->dt;
+    rec->st = s->st;
+
+    return 1;
+}
+
+void trace_reader_close(trace_reader* r) {
+    gzclose(r->in);
+    free(r);
+}
@@ -0,0 +1,70 @@
+#include <inttypes.h>
+
+// Execution traces are gzip-compressed streams of variable-length records.
+// Each record describes one executed instruction and only the state that
+// changed since the previous record, so a tight loop costs a few bytes per
+// instruction before compression.
+#define TRACE_MAGIC "CH8T"
+#define TRACE_VERSION 2
+
+// Size in bytes of the in-memory ring between the emulator and the writer
+// thread. Must be a power of two.
+#define TRACE_RING_SIZE (1 << 20)
+
+// Record flags (first byte of every record)
+#define TRACE_PC   0x01 // 16-bit PC of the instruction follows (otherwise implied)
+#define TRACE_REGS 0x02 // 16-bit V register mask follows, then one byte per set bit
+#define TRACE_I    0x04 // 16-bit I register follows
+#define TRACE_SP   0x08 // 8-bit SP follows
+#define TRACE_DT   0x10 // 8-bit delay timer follows
+#define TRACE_ST   0x20 // 8-bit sound timer follows
+#define TRACE_MEM  0x40 // 16-bit address, 8-bit count and the written bytes follow
+#define TRACE_JUMP 0x80 // 16-bit PC after execution follows (otherwise PC + 2)
+
+// Set in a TRACE_MEM count when the store wrapped past the end of memory:
+// a second address, count and bytes follow for the part written from 0
+#define TRACE_MEM_MORE 0x80
+
+// Largest possible encoded record
+#define TRACE_MAX_RECORD 64
+
+struct chip;
+struct CPU;
+
+typedef struct trace trace;
+
+// A decoded trace record.
+typedef struct trace_record {
+    uint8_t flags;
+    uint16_t pc;
+    uint16_t opcode;
+
+    // Register values after execution
+    uint8_t v[16];
+    uint16_t reg_mask;
+    uint16_t address;
+    uint8_t sp;
+    uint8_t dt;
+    uint8_t st;
+
+    // Memory written by the instruction, from mem_address on and wrapping
+    // around to 0 past the end of memory
+    uint16_t mem_address;
+    uint8_t mem_count;
+    uint8_t mem[256];
+
+    // PC after execution
+    uint16_t next_pc;
+} trace_record;
+
+// Recording
+trace* trace_open(const char* filename);
+uint16_t trace_cycle(trace* t, struct chip* c, struct CPU* cpu);
+uint64_t trace_close(trace* t);
+
+// Reading
+typedef struct trace_reader trace_reader;
+
+trace_reader* trace_reader_open(const char* filename);
+int trace_reader_next(trace_reader* r, trace_record* rec);
+void trace_reader_close(trace_reader* r);
@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+// Prints an execution trace recorded with `chip8 -t`, one instruction per line.
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace file> [max records]\n", argv[0]);
+        return 1;
+    }
+
+    trace_reader* r = trace_reader_open(argv[1]);
+    if (r == NULL) {
+        fprintf(stderr, "%s: not a CHIP-8 trace\n", argv[1]);
+        return 1;
+    }
+
+    unsigned long long limit = argc > 2 ? strtoull(argv[2], NULL, 10) : 0;
+    unsigned long long count = 0;
+    trace_record rec;
+
+    while ((limit == 0 || count < limit) && trace_reader_next(r, &rec)) {
+        printf("%03x: %04x", rec.pc, rec.opcode);
+
+        for (int i = 0; i < 16; i++) {
+            if (rec.reg_mask & (1 << i)) {
+                printf(" V%X=%02x", i, rec.v[i]);
+            }
+        }
+        if (rec.flags & TRACE_I) {
+            printf(" I=%03x", rec.address);
+        }
+        if (rec.flags & TRACE_SP) {
+            printf(" SP=%d", rec.sp);
+        }
+        if (rec.flags & TRACE_DT) {
+            printf(" DT=%d", rec.dt);
+        }
+        if (rec.flags & TRACE_ST) {
+            printf(" ST=%d", rec.st);
+        }
+        if (rec.flags & TRACE_MEM) {
+            printf(" [%03x]=", rec.mem_address);
+            for (int i = 0; i < rec.mem_count; i++) {
+                printf("%02x", rec.mem[i]);
+            }
+        }
+        if (rec.flags & TRACE_JUMP) {
+            printf(" -> %03x", rec.next_pc);
+        }
+        printf("\n");
+
+        count++;
+    }
+
+    trace_reader_close(r);
+
+    return 0;
+}
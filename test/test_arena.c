@@ -0,0 +1,129 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "../src/cpu.h"
+#include "../src/arena.h"
+
+#define INSTANCES 1000
+
+// Draws a sprite over and over, keeping everything in registers
+static const uint8_t draw_rom[] = {
+    0xA2, 0x08, // 200: LD I, 208
+    0xD0, 0x15, // 202: DRW V0, V1, 5
+    0x70, 0x01, // 204: ADD V0, 1
+    0x12, 0x02, // 206: JP 202
+    0xF0, 0x90, 0x90, 0x90, 0xF0,
+};
+
+static arena* load_arena(int capacity) {
+    chip* c = init();
+    for (size_t i = 0; i < sizeof(draw_rom); i++) {
+        c->mem[ROM_START + i] = draw_rom[i];
+    }
+    CPU* cpu = initialize();
+
+    arena* a = arena_create(c, cpu, capacity);
+    assert(a != NULL);
+    free(cpu);
+    free(c);
+    return a;
+}
+
+// Every instance starts with the font, the ROM and reset registers, and
+// its CPU on a cache line of its own.
+void test_start_state() {
+    arena* a = load_arena(4);
+    assert(arena_reset(a, 0) && arena_reset(a, 3));
+
+    for (int i = 0; i < 4; i += 3) {
+        chip* c = arena_chip(a, i);
+        assert(c->mem[0] == 0xF0 && c->mem[1] == 0x90);
+        assert(c->mem[ROM_START] == 0xA2);
+        assert(c->planes == 1);
+        assert(arena_cpu(a, i)->pc == ROM_START);
+        assert((uintptr_t) arena_cpu(a, i) % ARENA_LINE == 0);
+    }
+    assert((uintptr_t) arena_cpu(a, 1) - (uintptr_t) arena_cpu(a, 0) >= ARENA_LINE);
+
+    arena_destroy(a);
+
+    printf("TEST_START_STATE PASS\n");
+}
+
+// Writes stay in the instance that made them, until it is reset.
+void test_private_writes() {
+    arena* a = load_arena(2);
+    assert(arena_reset(a, 0) && arena_reset(a, 1));
+    chip* first = arena_chip(a, 0);
+    chip* second = arena_chip(a, 1);
+
+    first->mem[0] = 0x12;
+    first->mem[ROM_START + 0x100] = 0x34;
+    first->game_screen[0][0][0] = 1;
+    arena_cpu(a, 0)->pc = 0x300;
+    assert(second->mem[0] == 0xF0);
+    assert(second->mem[ROM_START + 0x100] == 0);
+    assert(second->game_screen[0][0][0] == 0);
+
+    assert(arena_reset(a, 0));
+    assert(first->mem[0] == 0xF0);
+    assert(first->mem[ROM_START + 0x100] == 0);
+    assert(first->game_screen[0][0][0] == 0);
+    assert(arena_cpu(a, 0)->pc == ROM_START);
+
+    arena_destroy(a);
+
+    printf("TEST_PRIVATE_WRITES PASS\n");
+}
+
+// Idle instances take no memory of their own, and running ones only the
+// pages they wrote.
+void test_instance_memory() {
+    size_t page = sysconf(_SC_PAGESIZE);
+    arena* a = load_arena(INSTANCES);
+
+    for (int i = 0; i < INSTANCES; i++) {
+        assert(arena_reset(a, i));
+        assert(arena_chip(a, i)->mem[ROM_START] == 0xA2);
+    }
+    size_t idle = arena_private_bytes(a);
+    assert(idle == 0);
+
+    // Drawing only writes the page with the screen
+    for (int i = 0; i < INSTANCES; i++) {
+        for (int k = 0; k < 1 + 3 * 50; k++) {
+            cycle(arena_chip(a, i), arena_cpu(a, i));
+        }
+        assert(arena_cpu(a, i)->v[0] == 50);
+    }
+    size_t running = arena_private_bytes(a);
+    assert(running <= INSTANCES * page);
+
+    // Storing registers writes the page they go to as well
+    for (int i = 0; i < INSTANCES; i++) {
+        execute(arena_chip(a, i), arena_cpu(a, i), 0xF055);
+    }
+    size_t stored = arena_private_bytes(a);
+    assert(stored <= 2 * INSTANCES * page);
+
+    for (int i = 0; i < INSTANCES; i++) {
+        arena_release(a, i);
+    }
+    assert(arena_private_bytes(a) == 0);
+
+    printf("Private memory per instance: %zu bytes idle, %zu running, %zu after Fx55 (chip is %zu bytes)\n",
+           idle / INSTANCES, running / INSTANCES, stored / INSTANCES, sizeof(chip));
+    arena_destroy(a);
+
+    printf("TEST_INSTANCE_MEMORY PASS\n");
+}
+
+int main() {
+    test_start_state();
+    test_private_writes();
+    test_instance_memory();
+
+    return 0;
+}
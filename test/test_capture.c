@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/cpu.h"
+#include "../src/capture.h"
+
+static uint8_t* read_file(const char* filename, long* size) {
+    FILE* f = fopen(filename, "rb");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = malloc(*size);
+    size_t read = fread(data, 1, *size, f);
+    assert(read == (size_t) *size);
+    (void) read;
+    fclose(f);
+    return data;
+}
+
+void test_parse_palette() {
+    uint32_t palette[4] = {1, 2, 3, 4};
+
+    assert(parse_palette("102030,aabbcc", palette));
+    assert(palette[0] == 0x102030 && palette[1] == 0xAABBCC);
+    assert(palette[2] == 3 && palette[3] == 4);
+
+    assert(!parse_palette("12345", palette));
+    assert(!parse_palette("000000;ffffff", palette));
+    assert(!parse_palette("000000,111111,222222,333333,444444", palette));
+
+    printf("TEST_PARSE_PALETTE PASS\n");
+}
+
+// Raw frames are RGB24 on a fixed hires canvas, with lores pixels doubled.
+void test_raw_frames() {
+    const char* filename = "/tmp/test_capture.raw";
+    capture_options opts;
+    capture_default_options(&opts, filename);
+    assert(opts.format == CAPTURE_RAW);
+    opts.scale = 1;
+    opts.wait = 1;
+    parse_palette("000000,ff0000,00ff00,0000ff", opts.palette);
+
+    capture* cap = capture_open(filename, &opts);
+    assert(cap != NULL);
+
+    chip* c = calloc(1, sizeof(chip));
+
+    // Lores: top-left pixel on plane 0 covers 2x2 output pixels
+    c->game_screen[0][0][0] = 1ULL << 63;
+    capture_frame(cap, c);
+
+    // Hires: a pixel on both planes at (127, 63)
+    c->hires = 1;
+    c->game_screen[0][0][0] = 0;
+    c->game_screen[0][63][1] = 1;
+    c->game_screen[1][63][1] = 1;
+    capture_frame(cap, c);
+
+    uint64_t dropped;
+    uint64_t written = capture_close(cap, &dropped);
+    assert(written == 2);
+    (void) written;
+    assert(dropped == 0);
+
+    long size;
+    uint8_t* data = read_file(filename, &size);
+    long frame = HIRES_WIDTH * HIRES_HEIGHT * 3;
+    assert(size == frame * 2);
+
+    assert(data[0] == 0xFF && data[3] == 0xFF);
+    assert(data[HIRES_WIDTH * 3] == 0xFF && data[HIRES_WIDTH * 3 + 3] == 0xFF);
+    assert(data[6] == 0);
+
+    uint8_t* last = data + frame + frame - 3;
+    assert(last[0] == 0 && last[1] == 0 && last[2] == 0xFF);
+    assert(last[-3] == 0 && last[-1] == 0);
+
+    free(data);
+    free(c);
+    remove(filename);
+
+    printf("TEST_RAW_FRAMES PASS\n");
+}
+
+// Unchanged frames are merged into one GIF frame with a longer delay.
+void test_gif_merges_frames() {
+    const char* filename = "/tmp/test_capture.gif";
+    capture_options opts;
+    capture_default_options(&opts, filename);
+    assert(opts.format == CAPTURE_GIF);
+    opts.wait = 1;
+
+    capture* cap = capture_open(filename, &opts);
+    chip* c = calloc(1, sizeof(chip));
+
+    for (int i = 0; i < 60; i++) {
+        if (i == 30) {
+            c->game_screen[0][5][0] = 0xFF;
+        }
+        capture_frame(cap, c);
+    }
+    uint64_t written = capture_close(cap, NULL);
+    assert(written == 2);
+    (void) written;
+
+    long size;
+    uint8_t* data = read_file(filename, &size);
+    assert(memcmp(data, "GIF89a", 6) == 0);
+    assert(data[size - 1] == 0x3B);
+
+    // Both graphic control extensions carry half a second
+    int delays = 0;
+    for (long i = 0; i + 5 < size; i++) {
+        if (data[i] == 0x21 && data[i + 1] == 0xF9 && data[i + 2] == 4) {
+            assert(data[i + 4] == 50 && data[i + 5] == 0);
+            delays++;
+        }
+    }
+    assert(delays == 2);
+
+    free(data);
+    free(c);
+    remove(filename);
+
+    printf("TEST_GIF_MERGES_FRAMES PASS\n");
+}
+
+// Frames longer than the 16-bit GIF delay are split into several frames.
+void test_gif_long_frame() {
+    const char* filename = "/tmp/test_capture_long.gif";
+    capture_options opts;
+    capture_default_options(&opts, filename);
+    opts.wait = 1;
+
+    capture* cap = capture_open(filename, &opts);
+    chip* c = calloc(1, sizeof(chip));
+
+    // 40000 unchanged frames last 66666cs
+    for (int i = 0; i < 40000; i++) {
+        capture_frame(cap, c);
+    }
+    uint64_t written = capture_close(cap, NULL);
+    assert(written == 2);
+    (void) written;
+
+    long size;
+    uint8_t* data = read_file(filename, &size);
+
+    int delays[2];
+    int count = 0;
+    for (long i = 0; i + 5 < size; i++) {
+        if (data[i] == 0x21 && data[i + 1] == 0xF9 && data[i + 2] == 4) {
+            assert(count < 2);
+            delays[count++] = data[i + 4] | data[i + 5] << 8;
+        }
+    }
+    assert(count == 2);
+    assert(delays[0] == 65535 && delays[1] == 66666 - 65535);
+    (void) delays;
+
+    free(data);
+    free(c);
+    remove(filename);
+
+    printf("TEST_GIF_LONG_FRAME PASS\n");
+}
+
+int main() {
+    test_parse_palette();
+    test_raw_frames();
+    test_gif_merges_frames();
+    test_gif_long_frame();
+    return 0;
+}
@@ -13,38 +13,85 @@ void test_initialize() {
     assert(cpu->dt == 0);
     assert(cpu->st == 0);
 
+    free(cpu);
+
     printf("TEST_INITIALIZE PASS\n");
 }
 
-// Checks the contents of a simple dummy ROM for correctness.
+// Runs a simple dummy ROM and checks the registers it leaves behind.
 void test_cycle() {
     // Initialize CPU
+    chip* c = calloc(1, sizeof(chip));
     CPU* cpu = initialize();
 
-    // 4 instructions, each 2 bytes long
-    uint8_t* test_mem = malloc(4 * 2);
-    test_mem[0] = 96;
-    test_mem[1] = 0;
-    test_mem[2] = 97;
-    test_mem[3] = 2;
-    test_mem[4] = 112;
-    test_mem[5] = 17;
-    test_mem[6] = 131;
-    test_mem[7] = 0;
+    // 4 instructions, each 2 bytes long: LD V0, 0; LD V1, 2; ADD V0, 17; LD V3, V0
+    uint8_t rom[8] = {96, 0, 97, 2, 112, 17, 131, 0};
+    for (int i = 0; i < sizeof(rom); i++) {
+        c->mem[ROM_START + i] = rom[i];
+    }
 
-    run(test_mem, cpu);
+    for (int i = 0; i < 4; i++) {
+        cycle(c, cpu);
+    }
 
     // Check the CPU registers
     assert(cpu->v[0] == 17);
     assert(cpu->v[1] == 2);
     assert(cpu->v[3] == 17);
+    assert(cpu->pc == ROM_START + sizeof(rom));
 
     // Free memory
     free(cpu);
-    free(test_mem);
+    free(c);
+
+    printf("TEST_CYCLE PASS\n");
+}
+
+// Vf holds the carry or the no-borrow flag after arithmetic, and when the
+// result goes to Vf itself the flag overwrites it.
+void test_arithmetic_flags() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    // ADD V0, V1 clears a carry left over from before
+    cpu->v[0] = 0x10;
+    cpu->v[1] = 0x20;
+    cpu->v[0xf] = 1;
+    execute(c, cpu, 0x8014);
+    assert(cpu->v[0] == 0x30 && cpu->v[0xf] == 0);
+
+    cpu->v[0] = 0xF0;
+    execute(c, cpu, 0x8014);
+    assert(cpu->v[0] == 0x10 && cpu->v[0xf] == 1);
+
+    // Subtracting equal values doesn't borrow
+    cpu->v[0] = 5;
+    cpu->v[1] = 5;
+    execute(c, cpu, 0x8015);
+    assert(cpu->v[0] == 0 && cpu->v[0xf] == 1);
+
+    cpu->v[0] = 5;
+    execute(c, cpu, 0x8017);
+    assert(cpu->v[0] == 0 && cpu->v[0xf] == 1);
+
+    cpu->v[0] = 4;
+    execute(c, cpu, 0x8015);
+    assert(cpu->v[0] == 255 && cpu->v[0xf] == 0);
+
+    // ADD VF, V1: the carry wins over the sum
+    cpu->v[0xf] = 0xFF;
+    cpu->v[1] = 1;
+    execute(c, cpu, 0x8F14);
+    assert(cpu->v[0xf] == 1);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_ARITHMETIC_FLAGS PASS\n");
 }
 
 int main() {
     test_initialize();
     test_cycle();
+    test_arithmetic_flags();
 }
\ No newline at end of file
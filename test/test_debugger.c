@@ -0,0 +1,256 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../src/cpu.h"
+#include "../src/debugger.h"
+#include "../src/trace.h"
+
+// LD V0, 42; LD I, 0x300; LD B, V0; ADD V1, 1; JP 0x200
+static uint8_t rom[] = {0x60, 42, 0xA3, 0x00, 0xF0, 0x33, 0x71, 0x01, 0x12, 0x00};
+
+static chip* load_test_rom() {
+    chip* c = calloc(1, sizeof(chip));
+    memcpy(&c->mem[0x200], rom, sizeof(rom));
+    return c;
+}
+
+// Runs until the debugger stops, up to a limit of instructions.
+static void run_until_stopped(debugger* d, chip* c, CPU* cpu) {
+    for (int i = 0; i < 100 && !d->stopped; i++) {
+        debug_cycle(d, c, cpu);
+    }
+}
+
+// Breakpoints stop before the instruction, and resuming steps over them.
+void test_breakpoint() {
+    chip* c = load_test_rom();
+    CPU* cpu = initialize();
+    debugger* d = debugger_create();
+
+    assert(!debugger_active(d));
+    debugger_add_breakpoint(d, 0x206);
+    assert(debugger_active(d));
+
+    run_until_stopped(d, c, cpu);
+    assert(d->stopped && d->stop_reason == STOP_BREAKPOINT);
+    assert(cpu->pc == 0x206);
+    assert(cpu->v[1] == 0);
+
+    // Single step over the breakpoint
+    debugger_resume(d, 1);
+    run_until_stopped(d, c, cpu);
+    assert(d->stop_reason == STOP_STEP);
+    assert(cpu->pc == 0x208);
+    assert(cpu->v[1] == 1);
+
+    // Continue around the loop back to the breakpoint
+    debugger_resume(d, 0);
+    run_until_stopped(d, c, cpu);
+    assert(d->stop_reason == STOP_BREAKPOINT);
+    assert(cpu->pc == 0x206);
+
+    debugger_remove_breakpoint(d, 0x206);
+    debugger_resume(d, 0);
+    assert(!debugger_active(d));
+
+    debugger_destroy(d);
+    free(cpu);
+    free(c);
+
+    printf("TEST_BREAKPOINT PASS\n");
+}
+
+// Memory and register watchpoints stop after the instruction that made the change.
+void test_watchpoints() {
+    chip* c = load_test_rom();
+    CPU* cpu = initialize();
+    debugger* d = debugger_create();
+
+    assert(debugger_add_watchpoint(d, 0x302, 1));
+    run_until_stopped(d, c, cpu);
+    assert(d->stop_reason == STOP_WATCH_MEM);
+    assert(d->stop_address == 0x302);
+    assert(cpu->pc == 0x206);
+    assert(c->mem[0x302] == 2);
+
+    debugger_remove_watchpoint(d, 0x302, 1);
+    d->reg_watch = 1 << 1;
+    debugger_resume(d, 0);
+    run_until_stopped(d, c, cpu);
+    assert(d->stop_reason == STOP_WATCH_REG);
+    assert(cpu->pc == 0x208);
+    assert(cpu->v[1] == 1);
+
+    debugger_destroy(d);
+    free(cpu);
+    free(c);
+
+    printf("TEST_WATCHPOINTS PASS\n");
+}
+
+// A store that wraps past the end of memory hits watchpoints at either end.
+void test_wrapped_watchpoint() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    debugger* d = debugger_create();
+
+    // LD [I], V3 with I two bytes from the end of memory
+    c->mem[0x200] = 0xF3;
+    c->mem[0x201] = 0x55;
+    cpu->address = 0xFFFE;
+
+    assert(debugger_add_watchpoint(d, 0x0001, 1));
+    debug_cycle(d, c, cpu);
+    assert(d->stopped && d->stop_reason == STOP_WATCH_MEM);
+    assert(d->stop_address == 0x0001);
+
+    debugger_destroy(d);
+    free(cpu);
+    free(c);
+
+    printf("TEST_WRAPPED_WATCHPOINT PASS\n");
+}
+
+// A packet longer than the buffer is rejected without dropping the client.
+void test_oversized_packet() {
+    chip* c = load_test_rom();
+    CPU* cpu = initialize();
+    debugger* d = debugger_create();
+
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    d->client_fd = fds[0];
+
+    int size = 3 * GDB_MAX_PACKET;
+    char* packet = malloc(size);
+    memset(packet, 'a', size);
+    packet[0] = '$';
+    memcpy(packet + size - 3, "#00", 3);
+    assert(write(fds[1], packet, size) == size);
+    assert(write(fds[1], "$g#67", 5) == 5);
+
+    for (int i = 0; i < 8; i++) {
+        assert(debugger_poll(d, c, cpu, 0));
+    }
+
+    char reply[1024];
+    int n = read(fds[1], reply, sizeof(reply) - 1);
+    assert(n > 0);
+    reply[n] = '\0';
+    assert(strstr(reply, "$E01#") != NULL);
+
+    // The registers come back for the packet after it
+    assert(strstr(reply, "$0000") != NULL);
+
+    close(fds[1]);
+    free(packet);
+    debugger_destroy(d);
+    free(cpu);
+    free(c);
+
+    printf("TEST_OVERSIZED_PACKET PASS\n");
+}
+
+// Sends a packet from the client end and returns the reply payload.
+static const char* exchange(debugger* d, chip* c, CPU* cpu, int client, const char* payload) {
+    static char reply[256];
+    char packet[256];
+    int len = snprintf(packet, sizeof(packet), "$%s#00", payload);
+    assert(write(client, packet, len) == len);
+    assert(debugger_poll(d, c, cpu, 0));
+
+    int n = read(client, reply, sizeof(reply) - 1);
+    assert(n > 0);
+    reply[n] = '\0';
+    char* start = strchr(reply, '$');
+    assert(start != NULL);
+    *strchr(start, '#') = '\0';
+    return start + 1;
+}
+
+// Memory writes and monitor commands with bad hex digits are refused.
+void test_bad_hex() {
+    chip* c = load_test_rom();
+    CPU* cpu = initialize();
+    debugger* d = debugger_create();
+
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    d->client_fd = fds[0];
+
+    assert(strcmp(exchange(d, c, cpu, fds[1], "M300,2:41zz"), "E01") == 0);
+    assert(c->mem[0x300] == 0 && c->mem[0x301] == 0);
+    assert(strcmp(exchange(d, c, cpu, fds[1], "M300,2:4142"), "OK") == 0);
+    assert(c->mem[0x300] == 0x41 && c->mem[0x301] == 0x42);
+
+    // "watch v1" in hex, then with a bad digit and with an odd one out
+    assert(strcmp(exchange(d, c, cpu, fds[1], "qRcmd,7761746368207631"), "OK") == 0);
+    assert(d->reg_watch == 1 << 1);
+    assert(strcmp(exchange(d, c, cpu, fds[1], "qRcmd,7761746368207g32"), "E01") == 0);
+    assert(strcmp(exchange(d, c, cpu, fds[1], "qRcmd,776174636820763"), "E01") == 0);
+    assert(d->reg_watch == 1 << 1);
+
+    close(fds[1]);
+    debugger_destroy(d);
+    free(cpu);
+    free(c);
+
+    printf("TEST_BAD_HEX PASS\n");
+}
+
+// Instructions run under the debugger are traced, and a breakpoint stop
+// records nothing.
+void test_traced_debugging() {
+    chip* c = load_test_rom();
+    CPU* cpu = initialize();
+    debugger* d = debugger_create();
+
+    char filename[] = "/tmp/chip8-trace-XXXXXX";
+    close(mkstemp(filename));
+    d->trace = trace_open(filename);
+    assert(d->trace != NULL);
+
+    // Stops before the fourth instruction, then runs on through the loop
+    debugger_add_breakpoint(d, 0x206);
+    int executed = 0;
+    for (int i = 0; i < 20; i++) {
+        if (d->stopped) {
+            debugger_resume(d, 0);
+        }
+        if (debug_cycle(d, c, cpu) != 0) {
+            executed++;
+        }
+    }
+    assert(executed > 0 && executed < 20);
+    assert(trace_close(d->trace) == (uint64_t) executed);
+
+    trace_reader* r = trace_reader_open(filename);
+    assert(r != NULL);
+    trace_record rec;
+    int records = 0;
+    while (trace_reader_next(r, &rec)) {
+        assert(rec.pc == 0x200 + (records % 5) * 2);
+        records++;
+    }
+    assert(records == executed);
+
+    trace_reader_close(r);
+    remove(filename);
+    debugger_destroy(d);
+    free(cpu);
+    free(c);
+
+    printf("TEST_TRACED_DEBUGGING PASS\n");
+}
+
+int main() {
+    test_breakpoint();
+    test_watchpoints();
+    test_wrapped_watchpoint();
+    test_oversized_packet();
+    test_traced_debugging();
+    test_bad_hex();
+}
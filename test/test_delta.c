@@ -0,0 +1,120 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/cpu.h"
+#include "../src/delta.h"
+
+// A receiver applying every message ends up with the sender's screen.
+void test_roundtrip() {
+    chip* c = calloc(1, sizeof(chip));
+    screen_copy* sent = calloc(1, sizeof(screen_copy));
+    screen_copy* received = calloc(1, sizeof(screen_copy));
+    uint8_t* msg = malloc(DELTA_MAX_MESSAGE);
+
+    // Nothing drawn yet
+    assert(encode_delta(c, sent, msg) == 0);
+
+    // A few sparse pixels
+    c->game_screen[0][3][0] = 0x8000000000000001;
+    c->game_screen[1][40][1] = 0x00F0000000000000;
+    size_t len = encode_delta(c, sent, msg);
+    assert(len > DELTA_HEADER);
+    assert(msg[2] == 2 && msg[3] == 0);
+    assert(apply_delta(msg, len, received));
+    assert(memcmp(received->screen, c->game_screen, sizeof(c->game_screen)) == 0);
+
+    // Unchanged screen sends nothing
+    assert(encode_delta(c, sent, msg) == 0);
+
+    // Random noise over every row, in hires
+    srand(1);
+    for (int p = 0; p < SCREEN_PLANES; p++) {
+        for (int y = 0; y < HIRES_HEIGHT; y++) {
+            for (int w = 0; w < SCREEN_WORDS; w++) {
+                c->game_screen[p][y][w] = (uint64_t) rand() << 40 ^ (uint64_t) rand() << 20 ^ rand();
+            }
+        }
+    }
+    c->hires = 1;
+    len = encode_delta(c, sent, msg);
+    assert(len <= DELTA_MAX_MESSAGE);
+    assert(apply_delta(msg, len, received));
+    assert(received->hires);
+    assert(memcmp(received->screen, c->game_screen, sizeof(c->game_screen)) == 0);
+
+    // Clearing back to lores
+    memset(c->game_screen, 0, sizeof(c->game_screen));
+    c->hires = 0;
+    len = encode_delta(c, sent, msg);
+    assert(apply_delta(msg, len, received));
+    assert(!received->hires);
+    assert(memcmp(received->screen, c->game_screen, sizeof(c->game_screen)) == 0);
+
+    free(msg);
+    free(received);
+    free(sent);
+    free(c);
+
+    printf("TEST_ROUNDTRIP PASS\n");
+}
+
+// Alternating zero and nonzero bytes are the worst case for the RLE, and
+// must still fit the bound the server allocates for.
+void test_worst_case() {
+    chip* c = calloc(1, sizeof(chip));
+    screen_copy* sent = calloc(1, sizeof(screen_copy));
+    screen_copy* received = calloc(1, sizeof(screen_copy));
+    uint8_t* msg = malloc(DELTA_MAX_MESSAGE);
+
+    for (int p = 0; p < SCREEN_PLANES; p++) {
+        for (int y = 0; y < HIRES_HEIGHT; y++) {
+            for (int w = 0; w < SCREEN_WORDS; w++) {
+                c->game_screen[p][y][w] = 0xFF00FF00FF00FF00;
+            }
+        }
+    }
+    c->hires = 1;
+    size_t len = encode_delta(c, sent, msg);
+    assert(len <= DELTA_MAX_MESSAGE);
+    assert(apply_delta(msg, len, received));
+    assert(memcmp(received->screen, c->game_screen, sizeof(c->game_screen)) == 0);
+
+    free(msg);
+    free(received);
+    free(sent);
+    free(c);
+
+    printf("TEST_WORST_CASE PASS\n");
+}
+
+// Truncated or corrupt messages are rejected rather than read past.
+void test_malformed() {
+    chip* c = calloc(1, sizeof(chip));
+    screen_copy* sent = calloc(1, sizeof(screen_copy));
+    screen_copy* received = calloc(1, sizeof(screen_copy));
+    uint8_t* msg = malloc(DELTA_MAX_MESSAGE);
+
+    c->game_screen[0][10][0] = 0x123456789ABCDEF0;
+    size_t len = encode_delta(c, sent, msg);
+
+    assert(!apply_delta(msg, len - 1, received));
+    assert(!apply_delta(msg, DELTA_HEADER - 1, received));
+
+    msg[DELTA_HEADER] = HIRES_HEIGHT;
+    assert(!apply_delta(msg, len, received));
+
+    free(msg);
+    free(received);
+    free(sent);
+    free(c);
+
+    printf("TEST_MALFORMED PASS\n");
+}
+
+int main() {
+    test_roundtrip();
+    test_worst_case();
+    test_malformed();
+    return 0;
+}
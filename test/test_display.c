@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/cpu.h"
+
+static chip* blank_chip(int mode) {
+    chip* c = calloc(1, sizeof(chip));
+    c->mode = mode;
+    c->planes = 1;
+    return c;
+}
+
+static int pixel(chip* c, int plane, int x, int y) {
+    return c->game_screen[plane][y][x >> 6] >> (63 - (x & 63)) & 1;
+}
+
+// Sprites clip at the right edge in low resolution and never touch the second word.
+void test_lores_clipping() {
+    chip* c = blank_chip(MODE_CHIP8);
+    CPU* cpu = initialize();
+
+    c->mem[0x300] = 0xFF;
+    cpu->address = 0x300;
+    cpu->v[0] = 60;
+    cpu->v[1] = 0;
+    execute(c, cpu, 0xD011);
+
+    for (int x = 60; x < 64; x++) {
+        assert(pixel(c, 0, x, 0));
+    }
+    assert(!pixel(c, 0, 0, 0));
+    assert(c->game_screen[0][0][1] == 0);
+    assert(cpu->v[0xf] == 0);
+
+    // Drawing again erases the pixels and reports a collision
+    execute(c, cpu, 0xD011);
+    assert(c->game_screen[0][0][0] == 0);
+    assert(cpu->v[0xf] == 1);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_LORES_CLIPPING PASS\n");
+}
+
+// A 16x16 sprite straddling the word boundary, then scrolled in every direction.
+void test_hires_sprite_and_scroll() {
+    chip* c = blank_chip(MODE_SCHIP);
+    CPU* cpu = initialize();
+
+    execute(c, cpu, 0x00FF);
+    assert(screen_width(c) == HIRES_WIDTH);
+
+    memset(&c->mem[0x300], 0xFF, 32);
+    cpu->address = 0x300;
+    cpu->v[0] = 56;
+    cpu->v[1] = 10;
+    execute(c, cpu, 0xD010);
+
+    assert(pixel(c, 0, 56, 10) && pixel(c, 0, 71, 25));
+    assert(!pixel(c, 0, 55, 10) && !pixel(c, 0, 72, 10) && !pixel(c, 0, 56, 26));
+
+    execute(c, cpu, 0x00FB);
+    assert(!pixel(c, 0, 56, 10) && pixel(c, 0, 60, 10) && pixel(c, 0, 75, 10) && !pixel(c, 0, 76, 10));
+
+    execute(c, cpu, 0x00FC);
+    execute(c, cpu, 0x00FC);
+    assert(pixel(c, 0, 52, 10) && pixel(c, 0, 67, 10) && !pixel(c, 0, 68, 10));
+
+    execute(c, cpu, 0x00C5);
+    assert(!pixel(c, 0, 52, 10) && pixel(c, 0, 52, 15) && pixel(c, 0, 52, 30) && !pixel(c, 0, 52, 31));
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_HIRES_SPRITE_AND_SCROLL PASS\n");
+}
+
+// XO-CHIP draws each selected plane from consecutive sprite data.
+void test_xochip_planes() {
+    chip* c = blank_chip(MODE_XOCHIP);
+    CPU* cpu = initialize();
+
+    c->mem[0x300] = 0x80;
+    c->mem[0x301] = 0x40;
+    execute(c, cpu, 0xF301);
+    cpu->address = 0x300;
+    execute(c, cpu, 0xD011);
+
+    assert(pixel(c, 0, 0, 0) && !pixel(c, 0, 1, 0));
+    assert(pixel(c, 1, 1, 0) && !pixel(c, 1, 0, 0));
+
+    // Only clear the second plane
+    execute(c, cpu, 0xF201);
+    execute(c, cpu, 0x00E0);
+    assert(pixel(c, 0, 0, 0) && !pixel(c, 1, 1, 0));
+
+    // F000 nnnn loads a 16-bit address and is skipped as a whole
+    c->mem[0x200] = 0xF0;
+    c->mem[0x201] = 0x00;
+    c->mem[0x202] = 0x12;
+    c->mem[0x203] = 0x34;
+    cycle(c, cpu);
+    assert(cpu->address == 0x1234 && cpu->pc == 0x204);
+
+    cpu->pc = 0x200;
+    execute(c, cpu, 0x3000 | cpu->v[0]);
+    assert(cpu->pc == 0x204);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_XOCHIP_PLANES PASS\n");
+}
+
+int main() {
+    test_lores_clipping();
+    test_hires_sprite_and_scroll();
+    test_xochip_planes();
+}
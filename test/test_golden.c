@@ -0,0 +1,226 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "../src/cpu.h"
+#include "../src/state.h"
+#include "../src/quirks.h"
+
+// Golden-frame regression suite. Each line of golden.txt runs one ROM from
+// ../roms headless, with scripted input, and checks the screen hash at the
+// listed frames:
+//   <rom> <mode> <input> <frame>=<hash> ...
+// where input is "-" or comma-separated <frame>:<hex keypad mask> changes.
+// ROMs run in parallel. Run with -u to rewrite the hashes after an
+// intended change in output.
+#define GOLDEN_FILE "golden.txt"
+#define ROM_DIR "../roms/"
+#define MAX_ENTRIES 64
+#define MAX_CHECKPOINTS 16
+#define MAX_INPUTS 32
+
+typedef struct golden_entry {
+    char rom[128];
+    char mode_name[16];
+    char input_spec[256];
+
+    uint8_t mode;
+    int input_count;
+    uint64_t input_frame[MAX_INPUTS];
+    uint16_t input_keys[MAX_INPUTS];
+
+    int checkpoint_count;
+    uint64_t frame[MAX_CHECKPOINTS];
+    uint64_t expected[MAX_CHECKPOINTS];
+
+    // Filled in by the run
+    uint64_t actual[MAX_CHECKPOINTS];
+    int ok;
+} golden_entry;
+
+static int parse_entry(char* line, golden_entry* e) {
+    memset(e, 0, sizeof(golden_entry));
+
+    char* rest;
+    char* token = strtok_r(line, " \t\n", &rest);
+    if (token == NULL || token[0] == '#') {
+        return 0;
+    }
+    snprintf(e->rom, sizeof(e->rom), "%s", token);
+
+    // ROM names can't contain spaces here, so they are written as %20
+    for (char* space; (space = strstr(e->rom, "%20")) != NULL;) {
+        *space = ' ';
+        memmove(space + 1, space + 3, strlen(space + 3) + 1);
+    }
+
+    token = strtok_r(NULL, " \t\n", &rest);
+    assert(token != NULL);
+    snprintf(e->mode_name, sizeof(e->mode_name), "%s", token);
+    e->mode = strcmp(token, "schip") == 0 ? MODE_SCHIP : strcmp(token, "xochip") == 0 ? MODE_XOCHIP : MODE_CHIP8;
+
+    token = strtok_r(NULL, " \t\n", &rest);
+    assert(token != NULL);
+    snprintf(e->input_spec, sizeof(e->input_spec), "%s", token);
+    if (strcmp(token, "-") != 0) {
+        char* event_rest;
+        for (char* event = strtok_r(token, ",", &event_rest); event != NULL; event = strtok_r(NULL, ",", &event_rest)) {
+            assert(e->input_count < MAX_INPUTS);
+            unsigned long long frame;
+            unsigned int keys;
+            int fields = sscanf(event, "%llu:%x", &frame, &keys);
+            assert(fields == 2);
+            (void) fields;
+            e->input_frame[e->input_count] = frame;
+            e->input_keys[e->input_count] = keys;
+            e->input_count++;
+        }
+    }
+
+    while ((token = strtok_r(NULL, " \t\n", &rest)) != NULL) {
+        assert(e->checkpoint_count < MAX_CHECKPOINTS);
+        unsigned long long frame;
+        unsigned long long hash = 0;
+        int fields = sscanf(token, "%llu=%llx", &frame, &hash);
+        assert(fields >= 1);
+        (void) fields;
+        e->frame[e->checkpoint_count] = frame;
+        e->expected[e->checkpoint_count] = hash;
+        e->checkpoint_count++;
+    }
+
+    return 1;
+}
+
+// Runs one ROM to its last checkpoint, a frame at a time like the frontend.
+static void* run_entry(void* arg) {
+    golden_entry* e = arg;
+
+    chip* c = init();
+    c->mode = e->mode;
+    char path[256];
+    snprintf(path, sizeof(path), ROM_DIR "%s", e->rom);
+    load_rom(c, path);
+    c->quirks = select_quirks(path, c->mode);
+    CPU* cpu = initialize();
+
+    int input = 0;
+    int checkpoint = 0;
+    uint64_t last = e->checkpoint_count > 0 ? e->frame[e->checkpoint_count - 1] : 0;
+    for (uint64_t frame = 0; frame <= last; frame++) {
+        while (input < e->input_count && e->input_frame[input] <= frame) {
+            c->keys = e->input_keys[input++];
+        }
+
+        // Checkpoints see the screen at the start of their frame
+        while (checkpoint < e->checkpoint_count && e->frame[checkpoint] == frame) {
+            e->actual[checkpoint++] = screen_hash(c);
+        }
+
+        for (int i = 0; i < CPU_CLOCK_SPEED / FRAMES_PER_SECOND; i++) {
+            cycle(c, cpu);
+        }
+        if (cpu->dt > 0) {
+            cpu->dt--;
+        }
+        if (cpu->st > 0) {
+            cpu->st--;
+        }
+    }
+
+    e->ok = 1;
+    for (int i = 0; i < e->checkpoint_count; i++) {
+        if (e->actual[i] != e->expected[i]) {
+            e->ok = 0;
+        }
+    }
+
+    free(cpu);
+    free(c);
+    return NULL;
+}
+
+static void write_golden(golden_entry* entries, int count) {
+    FILE* f = fopen(GOLDEN_FILE, "w");
+    assert(f != NULL);
+
+    fprintf(f, "# Golden screen hashes, checked by test_golden (regenerate with ./test_golden -u)\n");
+    fprintf(f, "# <rom> <mode> <input: - or frame:keys,...> <frame>=<screen hash> ...\n");
+    for (int i = 0; i < count; i++) {
+        golden_entry* e = &entries[i];
+        for (char* p = e->rom; *p != '\0'; p++) {
+            if (*p == ' ') {
+                fputs("%20", f);
+            } else {
+                fputc(*p, f);
+            }
+        }
+        fprintf(f, " %s %s", e->mode_name, e->input_spec);
+        for (int k = 0; k < e->checkpoint_count; k++) {
+            fprintf(f, " %" PRIu64 "=%016" PRIx64, e->frame[k], e->actual[k]);
+        }
+        fprintf(f, "\n");
+    }
+
+    fclose(f);
+}
+
+int main(int argc, char** argv) {
+    int update = argc > 1 && strcmp(argv[1], "-u") == 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    FILE* f = fopen(GOLDEN_FILE, "r");
+    assert(f != NULL);
+    golden_entry* entries = calloc(MAX_ENTRIES, sizeof(golden_entry));
+    int count = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != NULL && count < MAX_ENTRIES) {
+        count += parse_entry(line, &entries[count]);
+    }
+    fclose(f);
+
+    pthread_t threads[MAX_ENTRIES];
+    for (int i = 0; i < count; i++) {
+        int err = pthread_create(&threads[i], NULL, run_entry, &entries[i]);
+        assert(err == 0);
+        (void) err;
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    if (update) {
+        write_golden(entries, count);
+        printf("Updated %d golden entries in " GOLDEN_FILE "\n", count);
+        free(entries);
+        return 0;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        golden_entry* e = &entries[i];
+        for (int k = 0; k < e->checkpoint_count; k++) {
+            if (e->actual[k] != e->expected[k]) {
+                printf("  %s frame %" PRIu64 ": screen hash %016" PRIx64 ", expected %016" PRIx64 "\n",
+                       e->rom, e->frame[k], e->actual[k], e->expected[k]);
+            }
+        }
+        failures += !e->ok;
+    }
+    fflush(stdout);
+    assert(failures == 0);
+    free(entries);
+    if (failures > 0) {
+        return 1;
+    }
+
+    printf("TEST_GOLDEN_FRAMES PASS (%d ROMs in %.1f ms)\n", count, ms);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/cpu.h"
+
+// Ex9E/ExA1 only test bits of the keypad mask, so no frontend is needed.
+void test_skip_on_key() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    cpu->v[2] = 0xB;
+    c->keys = 1 << 0xB;
+    execute(c, cpu, 0xE29E);
+    assert(cpu->pc == 0x202);
+    execute(c, cpu, 0xE2A1);
+    assert(cpu->pc == 0x202);
+
+    c->keys = 1 << 0xA;
+    execute(c, cpu, 0xE29E);
+    assert(cpu->pc == 0x202);
+    execute(c, cpu, 0xE2A1);
+    assert(cpu->pc == 0x204);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_SKIP_ON_KEY PASS\n");
+}
+
+// Fx0A repeats until a key has been pressed and released.
+void test_wait_for_key() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    // LD V5, K
+    c->mem[0x200] = 0xF5;
+    c->mem[0x201] = 0x0A;
+
+    cycle(c, cpu);
+    assert(cpu->pc == 0x200);
+
+    c->keys = (1 << 7) | (1 << 9);
+    cycle(c, cpu);
+    cycle(c, cpu);
+    assert(cpu->pc == 0x200);
+
+    c->keys = 1 << 9;
+    cycle(c, cpu);
+    assert(cpu->pc == 0x202);
+    assert(cpu->v[5] == 7);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_WAIT_FOR_KEY PASS\n");
+}
+
+int main() {
+    test_skip_on_key();
+    test_wait_for_key();
+}
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/cpu.h"
+#include "../src/state.h"
+#include "../src/latency.h"
+
+#define FRAME_NS (1000000000ULL / FRAMES_PER_SECOND)
+#define TRIALS 50
+
+// A program that toggles a pixel every time key 5 goes down, then waits
+// for it to be released.
+static const uint8_t toggle_rom[] = {
+    0x60, 0x05, // 200: LD V0, 5
+    0xA2, 0x10, // 202: LD I, 210
+    0xE0, 0x9E, // 204: SKP V0
+    0x12, 0x04, // 206: JP 204
+    0xD0, 0x11, // 208: DRW V0, V1, 1
+    0xE0, 0xA1, // 20A: SKNP V0
+    0x12, 0x0A, // 20C: JP 20A
+    0x12, 0x04, // 20E: JP 204
+    0x80,       // 210: sprite
+};
+
+static snapshot* load_toggle() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    c->planes = 1;
+    for (size_t i = 0; i < sizeof(toggle_rom); i++) {
+        c->mem[0x200 + i] = toggle_rom[i];
+    }
+
+    snapshot* s = malloc(sizeof(snapshot));
+    snapshot_save(s, c, cpu);
+    free(cpu);
+    free(c);
+    return s;
+}
+
+static latency_options toggle_options() {
+    latency_options opts = {
+        .key = 5,
+        .hold_ns = 3 * FRAME_NS,
+        .trials = TRIALS,
+        .timeout_frames = 10,
+        .instructions_per_frame = 10,
+        .seed = 1,
+    };
+    return opts;
+}
+
+// Sampling once per frame without vsync, a press shows up at the start of
+// the next frame, so never more than a frame late.
+void test_frame_schedule() {
+    snapshot* s = load_toggle();
+    latency_options opts = toggle_options();
+    uint64_t samples[TRIALS];
+
+    pacing p = {.schedule = SCHEDULE_FRAME};
+    int count = latency_run(s, &p, &opts, samples);
+    assert(count == TRIALS);
+    assert(samples[0] > 0);
+    assert(samples[count - 1] <= FRAME_NS);
+    for (int i = 1; i < count; i++) {
+        assert(samples[i - 1] <= samples[i]);
+    }
+
+    // Waiting for vblank adds up to another frame
+    p.vsync = 1;
+    assert(latency_run(s, &p, &opts, samples) == TRIALS);
+    assert(samples[count - 1] <= 2 * FRAME_NS);
+
+    free(s);
+
+    printf("TEST_FRAME_SCHEDULE PASS\n");
+}
+
+// Sampling before every instruction answers sooner than once per frame.
+void test_instruction_schedule() {
+    snapshot* s = load_toggle();
+    latency_options opts = toggle_options();
+    uint64_t per_frame[TRIALS];
+    uint64_t per_instruction[TRIALS];
+
+    pacing p = {.schedule = SCHEDULE_FRAME};
+    assert(latency_run(s, &p, &opts, per_frame) == TRIALS);
+    p.schedule = SCHEDULE_INSTRUCTION;
+    assert(latency_run(s, &p, &opts, per_instruction) == TRIALS);
+    assert(latency_percentile(per_instruction, TRIALS, 50) < latency_percentile(per_frame, TRIALS, 50));
+
+    free(s);
+
+    printf("TEST_INSTRUCTION_SCHEDULE PASS\n");
+}
+
+// When presenting takes most of a frame, a render thread keeps it from
+// holding up the emulation.
+void test_threaded_render() {
+    snapshot* s = load_toggle();
+    latency_options opts = toggle_options();
+    opts.instruction_ns = FRAME_NS / 20;
+    opts.present_ns = FRAME_NS * 3 / 4;
+    uint64_t inline_samples[TRIALS];
+    uint64_t threaded_samples[TRIALS];
+
+    pacing p = {.schedule = SCHEDULE_FRAME, .vsync = 1};
+    assert(latency_run(s, &p, &opts, inline_samples) == TRIALS);
+    p.threaded = 1;
+    assert(latency_run(s, &p, &opts, threaded_samples) == TRIALS);
+    assert(latency_percentile(threaded_samples, TRIALS, 50) <= latency_percentile(inline_samples, TRIALS, 50));
+    assert(threaded_samples[0] >= opts.present_ns);
+
+    free(s);
+
+    printf("TEST_THREADED_RENDER PASS\n");
+}
+
+void test_percentile() {
+    uint64_t sorted[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+    assert(latency_percentile(sorted, 10, 50) == 5);
+    assert(latency_percentile(sorted, 10, 90) == 9);
+    assert(latency_percentile(sorted, 10, 99) == 10);
+    assert(latency_percentile(sorted, 10, 100) == 10);
+    assert(latency_percentile(sorted, 10, 0) == 1);
+    assert(latency_percentile(sorted, 0, 50) == 0);
+
+    printf("TEST_PERCENTILE PASS\n");
+}
+
+int main() {
+    test_frame_schedule();
+    test_instruction_schedule();
+    test_threaded_render();
+    test_percentile();
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/cpu.h"
+#include "../src/state.h"
+#include "../src/lockstep.h"
+
+// Gets ADD V0, 1 wrong once V0 reaches 100
+static uint16_t step_faulty(void* ctx, chip* c, CPU* cpu) {
+    if (cpu->pc == 0x200 && cpu->v[0] == 100) {
+        cpu->pc += 2;
+        cpu->v[0] += 2;
+        return 0x7001;
+    }
+    return cycle(c, cpu);
+}
+
+static const backend faulty = {"faulty", NULL, NULL, step_faulty};
+
+// ADD V0, 1; JP 200
+static snapshot* counting_rom() {
+    snapshot* s = calloc(1, sizeof(snapshot));
+    CPU* cpu = initialize();
+    s->cpu = *cpu;
+    free(cpu);
+    init_sprites(&s->c);
+    s->c.planes = 1;
+
+    const uint8_t rom[] = {0x70, 0x01, 0x12, 0x00};
+    memcpy(&s->c.mem[ROM_START], rom, sizeof(rom));
+    return s;
+}
+
+void test_hash() {
+    snapshot* s = counting_rom();
+    uint64_t hash = state_hash(&s->c, &s->cpu);
+    assert(hash == state_hash(&s->c, &s->cpu));
+
+    s->c.mem[0xFFF] ^= 1;
+    assert(state_hash(&s->c, &s->cpu) != hash);
+    s->c.mem[0xFFF] ^= 1;
+
+    s->c.game_screen[1][63][1] ^= 1;
+    assert(state_hash(&s->c, &s->cpu) != hash);
+    s->c.game_screen[1][63][1] ^= 1;
+
+    s->cpu.rng++;
+    assert(state_hash(&s->c, &s->cpu) != hash);
+    s->cpu.rng--;
+    assert(state_hash(&s->c, &s->cpu) == hash);
+
+    free(s);
+
+    printf("TEST_HASH PASS\n");
+}
+
+// Cxkk draws from the CPU's own generator, so every CPU gets the same sequence.
+void test_random_is_per_cpu() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* first = initialize();
+    CPU* second = initialize();
+
+    uint8_t values[16];
+    for (int i = 0; i < 16; i++) {
+        execute(c, first, 0xC3FF);
+        values[i] = first->v[3];
+    }
+    for (int i = 0; i < 16; i++) {
+        execute(c, second, 0xC3FF);
+        assert(second->v[3] == values[i]);
+    }
+    assert(first->rng == second->rng);
+
+    free(second);
+    free(first);
+    free(c);
+
+    printf("TEST_RANDOM_IS_PER_CPU PASS\n");
+}
+
+void test_matching_backends() {
+    snapshot* start = counting_rom();
+    lockstep_options opts = {.instructions = 100000, .interval = 1000, .instructions_per_frame = 16};
+    lockstep_result result;
+
+    assert(lockstep_run(find_backend("cycle"), find_backend("debugger"), start, &opts, &result, NULL));
+    assert(!result.diverged);
+    assert(result.checked == 100000);
+
+    free(start);
+
+    printf("TEST_MATCHING_BACKENDS PASS\n");
+}
+
+// The divergence is pinned to the exact instruction even with a coarse interval.
+void test_bisects_divergence() {
+    snapshot* start = counting_rom();
+    snapshot* states = malloc(2 * sizeof(snapshot));
+    lockstep_options opts = {.instructions = 100000, .interval = 4096, .instructions_per_frame = 16};
+    lockstep_result result;
+
+    assert(lockstep_run(find_backend("cycle"), &faulty, start, &opts, &result, states));
+    assert(result.diverged);
+    assert(result.instruction == 200);
+    assert(result.pc == 0x200);
+    assert(result.opcode == 0x7001);
+    assert(states[0].cpu.v[0] == 101);
+    assert(states[1].cpu.v[0] == 102);
+
+    free(states);
+    free(start);
+
+    printf("TEST_BISECTS_DIVERGENCE PASS\n");
+}
+
+int main() {
+    test_hash();
+    test_random_is_per_cpu();
+    test_matching_backends();
+    test_bisects_divergence();
+    return 0;
+}
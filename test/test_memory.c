@@ -0,0 +1,191 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/cpu.h"
+
+// Stores and loads at the top of memory wrap around to address 0.
+void test_address_wrap() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    for (int i = 0; i < 16; i++) {
+        cpu->v[i] = i + 1;
+    }
+    cpu->address = EMU_MEMORY - 2;
+    execute(c, cpu, 0xF355);
+    assert(c->mem[EMU_MEMORY - 2] == 1);
+    assert(c->mem[EMU_MEMORY - 1] == 2);
+    assert(c->mem[0] == 3);
+    assert(c->mem[1] == 4);
+
+    execute(c, cpu, 0xF365);
+    assert(cpu->v[3] == 4);
+
+    cpu->address = EMU_MEMORY - 1;
+    cpu->v[5] = 123;
+    execute(c, cpu, 0xF533);
+    assert(c->mem[EMU_MEMORY - 1] == 1);
+    assert(c->mem[0] == 2);
+    assert(c->mem[1] == 3);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_ADDRESS_WRAP PASS\n");
+}
+
+// Nesting calls past the stack halts with a fault on the call that didn't fit.
+void test_stack_overflow() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    // CALL 200
+    c->mem[0x200] = 0x22;
+    c->mem[0x201] = 0x00;
+
+    int calls = 0;
+    while (!c->halted) {
+        cycle(c, cpu);
+        calls++;
+    }
+    assert(calls == STACK_SIZE);
+    assert(c->fault == FAULT_STACK_OVERFLOW);
+    assert(cpu->sp == STACK_SIZE - 1);
+    assert(cpu->pc == 0x200);
+
+    // Nothing runs after the fault
+    cycle(c, cpu);
+    assert(cpu->pc == 0x200);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_STACK_OVERFLOW PASS\n");
+}
+
+// Returning without a call halts instead of reading below the stack.
+void test_stack_underflow() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    // CALL 204; RET; RET
+    uint8_t program[] = {0x22, 0x04, 0x00, 0xEE, 0x00, 0xEE};
+    for (int i = 0; i < sizeof(program); i++) {
+        c->mem[0x200 + i] = program[i];
+    }
+
+    cycle(c, cpu);
+    cycle(c, cpu);
+    assert(cpu->pc == 0x202 && cpu->sp == 0 && !c->halted);
+    cycle(c, cpu);
+    assert(c->halted);
+    assert(c->fault == FAULT_STACK_UNDERFLOW);
+    assert(cpu->pc == 0x202);
+
+    // A stack pointer from a bad snapshot is caught the same way
+    chip* d = calloc(1, sizeof(chip));
+    cpu->pc = 0x204;
+    cpu->sp = 200;
+    d->mem[0x204] = 0x00;
+    d->mem[0x205] = 0xEE;
+    cycle(d, cpu);
+    assert(d->fault == FAULT_STACK_OVERFLOW);
+
+    free(d);
+    free(cpu);
+    free(c);
+
+    printf("TEST_STACK_UNDERFLOW PASS\n");
+}
+
+// The handlers as they were before addresses were wrapped and the stack checked
+__attribute__((noinline))
+static void unguarded_fx55(chip* c, CPU* cpu, opcode_params* params) {
+    for (int i = 0; i <= params->x; i++) {
+        c->mem[cpu->address + i] = cpu->v[i];
+    }
+}
+
+__attribute__((noinline))
+static void unguarded_fx65(chip* c, CPU* cpu, opcode_params* params) {
+    for (int i = 0; i <= params->x; i++) {
+        cpu->v[i] = c->mem[cpu->address + i];
+    }
+}
+
+__attribute__((noinline))
+static void unguarded_fx33(chip* c, CPU* cpu, opcode_params* params) {
+    c->mem[cpu->address] = (cpu->v[params->x] / 100) % 10;
+    c->mem[cpu->address + 1] = (cpu->v[params->x] / 10) % 10;
+    c->mem[cpu->address + 2] = cpu->v[params->x]% 10;
+}
+
+__attribute__((noinline))
+static void unguarded_2000(chip* c, CPU* cpu, opcode_params* params) {
+    cpu->sp++;
+    c->stack[cpu->sp] = cpu->pc;
+    cpu->pc = (uint16_t) ((params->x << 8) | params->kk);
+}
+
+__attribute__((noinline))
+static void unguarded_00ee(chip* c, CPU* cpu) {
+    cpu->pc = c->stack[cpu->sp];
+    cpu->sp--;
+}
+
+static double elapsed_ns(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+// Times the memory and stack handlers against the unguarded ones. This only
+// reports; the guards should cost next to nothing.
+void test_benchmark() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    opcode_params store = {15, 0, 0x55};
+    opcode_params bcd = {3, 0, 0x33};
+    opcode_params call = {3, 0, 0x00};
+    const int rounds = 2000000;
+
+    for (int guarded = 0; guarded < 2; guarded++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < rounds; i++) {
+            cpu->address = 0x300 + (i & 0xFF);
+            cpu->v[3] = i;
+            if (guarded) {
+                opcode_0xfx55(c, cpu, &store);
+                opcode_0xfx65(c, cpu, &store);
+                opcode_0xfx33(c, cpu, &bcd);
+                opcode_0x2000(c, cpu, &call);
+                opcode_0x00ee(c, cpu);
+            } else {
+                unguarded_fx55(c, cpu, &store);
+                unguarded_fx65(c, cpu, &store);
+                unguarded_fx33(c, cpu, &bcd);
+                unguarded_2000(c, cpu, &call);
+                unguarded_00ee(c, cpu);
+            }
+        }
+        printf("  %s: %.2f ns per round of 5 instructions\n", guarded ? "guarded" : "unguarded",
+               elapsed_ns(&start) / rounds);
+        assert(!c->halted);
+    }
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_BENCHMARK PASS\n");
+}
+
+int main() {
+    test_address_wrap();
+    test_stack_overflow();
+    test_stack_underflow();
+    test_benchmark();
+
+    return 0;
+}
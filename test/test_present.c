@@ -0,0 +1,170 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/cpu.h"
+#include "../src/present.h"
+
+// One output pixel, computed the slow way
+static uint32_t expected_pixel(chip* c, const present_options* opts, int x, int y) {
+    int size = opts->scale << (c->hires ? 0 : 1);
+    int sx = x / size;
+    int sy = y / size;
+    int bit = 63 - (sx & 63);
+    int index = (c->game_screen[0][sy][sx >> 6] >> bit & 1) | (c->game_screen[1][sy][sx >> 6] >> bit & 1) << 1;
+
+    int dim = 0;
+    if (size > 1 && opts->effect != PRESENT_PLAIN && y % size == size - 1) {
+        dim = 1;
+    }
+    if (size > 1 && opts->effect == PRESENT_GRID && x % size == size - 1) {
+        dim = 1;
+    }
+
+    uint32_t color = opts->palette[index];
+    return 0xFF000000 | (dim ? color >> 1 & 0x7F7F7F : color);
+}
+
+static void random_screen(chip* c) {
+    for (int p = 0; p < SCREEN_PLANES; p++) {
+        for (int y = 0; y < HIRES_HEIGHT; y++) {
+            for (int w = 0; w < SCREEN_WORDS; w++) {
+                c->game_screen[p][y][w] = (uint64_t) rand() << 42 ^ (uint64_t) rand() << 21 ^ rand();
+            }
+        }
+    }
+}
+
+// Every instruction set draws exactly the reference image at every scale and effect.
+void test_matches_reference() {
+    chip* c = calloc(1, sizeof(chip));
+    present_options opts;
+    present_default_options(&opts);
+
+    int width = HIRES_WIDTH * PRESENT_MAX_SCALE;
+    int height = HIRES_HEIGHT * PRESENT_MAX_SCALE;
+    uint32_t* pixels = malloc((size_t) width * height * sizeof(uint32_t));
+
+    srand(1);
+    for (int isa = PRESENT_SCALAR; isa <= PRESENT_AVX2; isa++) {
+        if (!present_set_isa(isa)) {
+            continue;
+        }
+        for (int scale = 1; scale <= PRESENT_MAX_SCALE; scale++) {
+            for (int effect = PRESENT_PLAIN; effect <= PRESENT_GRID; effect++) {
+                for (int hires = 0; hires <= 1; hires++) {
+                    random_screen(c);
+                    c->hires = hires;
+                    opts.scale = scale;
+                    opts.effect = effect;
+
+                    // Pitch wider than the image, like a texture might have
+                    present_frame(c, pixels, width * sizeof(uint32_t), &opts);
+
+                    for (int y = 0; y < HIRES_HEIGHT * scale; y++) {
+                        for (int x = 0; x < HIRES_WIDTH * scale; x++) {
+                            assert(pixels[(size_t) y * width + x] == expected_pixel(c, &opts, x, y));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    free(pixels);
+    free(c);
+
+    printf("TEST_MATCHES_REFERENCE PASS\n");
+}
+
+// A pixel that turns off fades towards the background over the next frames.
+void test_phosphor() {
+    chip* c = calloc(1, sizeof(chip));
+    phosphor* glow = calloc(1, sizeof(phosphor));
+    present_options opts;
+    present_default_options(&opts);
+    opts.scale = 1;
+    opts.palette[0] = 0x102030;
+    opts.palette[1] = 0x90A0B0;
+    opts.phosphor = glow;
+
+    int width = HIRES_WIDTH;
+    uint32_t* pixels = malloc((size_t) width * HIRES_HEIGHT * sizeof(uint32_t));
+
+    // Lores pixel (3, 1) covers output pixels (6-7, 2-3)
+    c->game_screen[0][1][0] = 1ULL << 60;
+    assert(present_frame(c, pixels, width * sizeof(uint32_t), &opts) == 0);
+    assert(pixels[2 * width + 6] == 0xFF90A0B0);
+    assert(pixels[3 * width + 7] == 0xFF90A0B0);
+    assert(pixels[0] == 0xFF102030);
+
+    c->game_screen[0][1][0] = 0;
+    assert(present_frame(c, pixels, width * sizeof(uint32_t), &opts) == 1);
+    assert(pixels[2 * width + 6] == 0xFF506070);
+    assert(present_frame(c, pixels, width * sizeof(uint32_t), &opts) == 1);
+    assert(pixels[2 * width + 6] == 0xFF304050);
+    assert(present_frame(c, pixels, width * sizeof(uint32_t), &opts) == 0);
+    assert(pixels[2 * width + 6] == 0xFF102030);
+
+    // Lighting it again shows it fully at once
+    c->game_screen[0][1][0] = 1ULL << 60;
+    present_frame(c, pixels, width * sizeof(uint32_t), &opts);
+    assert(pixels[2 * width + 6] == 0xFF90A0B0);
+
+    free(pixels);
+    free(glow);
+    free(c);
+
+    printf("TEST_PHOSPHOR PASS\n");
+}
+
+// Reports the time per frame at the default and largest scales. The
+// 0.2 ms per frame target applies at the default scale (640x320). At the
+// largest scale a frame is 13 MB of pixels, so the time is bound by memory
+// bandwidth and is only reported.
+#define TARGET_MS 0.2
+
+void test_timing() {
+    chip* c = calloc(1, sizeof(chip));
+    present_options opts;
+    present_default_options(&opts);
+    srand(2);
+    random_screen(c);
+    c->hires = 1;
+
+    int scales[2] = {opts.scale, PRESENT_MAX_SCALE};
+    for (int isa = PRESENT_SCALAR; isa <= PRESENT_AVX2; isa++) {
+        if (!present_set_isa(isa)) {
+            continue;
+        }
+        for (int i = 0; i < 2; i++) {
+            opts.scale = scales[i];
+            int width = HIRES_WIDTH * opts.scale;
+            uint32_t* pixels = malloc((size_t) width * HIRES_HEIGHT * opts.scale * sizeof(uint32_t));
+
+            const int frames = 200;
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int f = 0; f < frames; f++) {
+                present_frame(c, pixels, width * sizeof(uint32_t), &opts);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double ms = ((end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6) / frames;
+            printf("  isa %d, %dx%d: %.3f ms/frame%s\n", isa, width, HIRES_HEIGHT * opts.scale, ms,
+                   i == 0 ? (ms <= TARGET_MS ? " (within target)" : " (over target)") : "");
+            free(pixels);
+        }
+    }
+
+    free(c);
+
+    printf("TEST_TIMING PASS\n");
+}
+
+int main() {
+    test_matches_reference();
+    test_phosphor();
+    test_timing();
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/cpu.h"
+#include "../src/quirks.h"
+
+// 8xy6 shifts Vy into Vx on the VIP, and Vx in place everywhere else.
+void test_shift() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    cpu->v[1] = 0x10;
+    cpu->v[2] = 0x81;
+    execute(c, cpu, 0x8126);
+    assert(cpu->v[1] == 0x08);
+    assert(cpu->v[0xf] == 0);
+
+    c->quirks = QUIRKS_VIP;
+    cpu->v[1] = 0x10;
+    execute(c, cpu, 0x8126);
+    assert(cpu->v[1] == 0x40);
+    assert(cpu->v[0xf] == 1);
+
+    cpu->v[1] = 0x10;
+    execute(c, cpu, 0x812E);
+    assert(cpu->v[1] == 0x02);
+    assert(cpu->v[0xf] == 1);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_SHIFT PASS\n");
+}
+
+// Fx55/Fx65 move I past the registers on the VIP.
+void test_load_store() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    cpu->address = 0x300;
+    execute(c, cpu, 0xF355);
+    assert(cpu->address == 0x300);
+
+    c->quirks = QUIRKS_VIP;
+    execute(c, cpu, 0xF355);
+    assert(cpu->address == 0x304);
+    execute(c, cpu, 0xF065);
+    assert(cpu->address == 0x305);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_LOAD_STORE PASS\n");
+}
+
+// Bnnn adds V0, while SUPER-CHIP's Bxnn adds Vx.
+void test_jump() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    cpu->v[0] = 0x10;
+    cpu->v[3] = 0x20;
+    execute(c, cpu, 0xB345);
+    assert(cpu->pc == 0x355);
+
+    c->quirks = QUIRKS_SCHIP;
+    execute(c, cpu, 0xB345);
+    assert(cpu->pc == 0x365);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_JUMP PASS\n");
+}
+
+// Logic ops clear VF on the VIP only.
+void test_vf_reset() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    cpu->v[0xf] = 1;
+    execute(c, cpu, 0x8121);
+    assert(cpu->v[0xf] == 1);
+
+    c->quirks = QUIRKS_VIP;
+    execute(c, cpu, 0x8122);
+    assert(cpu->v[0xf] == 0);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_VF_RESET PASS\n");
+}
+
+// A sprite drawn over the bottom right corner is clipped, or wraps around
+// to the other three corners.
+void test_wrap() {
+    for (int profile = QUIRKS_MODERN; profile <= QUIRKS_XOCHIP; profile += QUIRKS_XOCHIP) {
+        chip* c = calloc(1, sizeof(chip));
+        CPU* cpu = initialize();
+        c->planes = 1;
+        c->quirks = profile;
+
+        c->mem[0x300] = 0xFF;
+        c->mem[0x301] = 0xFF;
+        cpu->address = 0x300;
+        cpu->v[0] = 60;
+        cpu->v[1] = 31;
+        execute(c, cpu, 0xD012);
+
+        int wrap = profile == QUIRKS_XOCHIP;
+        assert(c->game_screen[0][31][0] == (wrap ? 0xF00000000000000FULL : 0xFULL));
+        assert(c->game_screen[0][0][0] == (wrap ? 0xF00000000000000FULL : 0));
+        assert(c->game_screen[0][31][1] == 0);
+
+        // The same in high resolution
+        c->hires = 1;
+        cpu->v[0] = 124;
+        cpu->v[1] = 63;
+        execute(c, cpu, 0xD012);
+        assert(c->game_screen[0][63][1] == 0xFULL);
+        assert(c->game_screen[0][63][0] == (wrap ? 0xF000000000000000ULL : 0));
+        assert(c->game_screen[0][0][0] == (wrap ? 0xF00000000000000FULL ^ 0xF000000000000000ULL : 0));
+
+        free(cpu);
+        free(c);
+    }
+
+    printf("TEST_WRAP PASS\n");
+}
+
+// Known ROMs get their own profile; others follow the mode.
+void test_select() {
+    assert(parse_quirks("vip") == QUIRKS_VIP);
+    assert(parse_quirks("cosmac") == -1);
+
+    assert(select_quirks("../roms/BLINKY.ch8", MODE_CHIP8) == QUIRKS_SCHIP);
+    assert(select_quirks("../roms/Maze.ch8", MODE_XOCHIP) == QUIRKS_VIP);
+    assert(select_quirks("test_quirks.c", MODE_CHIP8) == QUIRKS_MODERN);
+    assert(select_quirks("test_quirks.c", MODE_XOCHIP) == QUIRKS_XOCHIP);
+
+    printf("TEST_SELECT PASS\n");
+}
+
+int main() {
+    test_shift();
+    test_load_store();
+    test_jump();
+    test_vf_reset();
+    test_wrap();
+    test_select();
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/cpu.h"
+#include "../src/state.h"
+#include "../src/search.h"
+
+// A combination lock: V5 counts how far along it is, and goes up when the
+// next key of 1, 2, 3 is held.
+static const uint8_t lock_rom[] = {
+    0x65, 0x00, // 200: LD V5, 0
+    0x61, 0x01, // 202: LD V1, 1
+    0x62, 0x02, // 204: LD V2, 2
+    0x63, 0x03, // 206: LD V3, 3
+    0x45, 0x00, // 208: SNE V5, 0
+    0x12, 0x20, // 20A: JP 220
+    0x45, 0x01, // 20C: SNE V5, 1
+    0x12, 0x28, // 20E: JP 228
+    0x45, 0x02, // 210: SNE V5, 2
+    0x12, 0x30, // 212: JP 230
+    0x12, 0x14, // 214: JP 214
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xE1, 0xA1, // 220: SKNP V1
+    0x75, 0x01, // 222: ADD V5, 1
+    0x12, 0x08, // 224: JP 208
+    0x00, 0x00,
+    0xE2, 0xA1, // 228: SKNP V2
+    0x75, 0x01, // 22A: ADD V5, 1
+    0x12, 0x08, // 22C: JP 208
+    0x00, 0x00,
+    0xE3, 0xA1, // 230: SKNP V3
+    0x75, 0x01, // 232: ADD V5, 1
+    0x12, 0x08, // 234: JP 208
+};
+
+static const uint16_t lock_actions[] = {0, 1 << 1, 1 << 2, 1 << 3, 1 << 4};
+
+static snapshot* load_lock() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    c->planes = 1;
+    for (size_t i = 0; i < sizeof(lock_rom); i++) {
+        c->mem[0x200 + i] = lock_rom[i];
+    }
+
+    snapshot* s = malloc(sizeof(snapshot));
+    snapshot_save(s, c, cpu);
+    free(cpu);
+    free(c);
+    return s;
+}
+
+static search_options lock_options(const predicate* goal) {
+    search_options opts = {
+        .actions = lock_actions,
+        .action_count = sizeof(lock_actions) / sizeof(lock_actions[0]),
+        .frames_per_step = 1,
+        .instructions_per_frame = 20,
+        .max_depth = 100,
+        .max_states = 100000,
+        .threads = 1,
+        .goal = goal,
+    };
+    return opts;
+}
+
+void test_parse_predicate() {
+    predicate p;
+
+    assert(parse_predicate("v5 == 3", &p));
+    assert(p.count == 1);
+    assert(p.conditions[0].field == FIELD_V && p.conditions[0].index == 5);
+    assert(p.conditions[0].compare == COMPARE_EQ && p.conditions[0].value == 3);
+
+    assert(parse_predicate("VA>=0x10&&mem[0x3F0] != 2 && pc<0x300", &p));
+    assert(p.count == 3);
+    assert(p.conditions[0].field == FIELD_V && p.conditions[0].index == 10);
+    assert(p.conditions[0].compare == COMPARE_GE && p.conditions[0].value == 16);
+    assert(p.conditions[1].field == FIELD_MEM && p.conditions[1].index == 0x3F0);
+    assert(p.conditions[1].compare == COMPARE_NE);
+    assert(p.conditions[2].field == FIELD_PC && p.conditions[2].compare == COMPARE_LT);
+
+    assert(!parse_predicate("", &p));
+    assert(!parse_predicate("v5", &p));
+    assert(!parse_predicate("vg == 1", &p));
+    assert(!parse_predicate("v5 = 1", &p));
+    assert(!parse_predicate("mem[0x10000] == 1", &p));
+    assert(!parse_predicate("v5 == 1 &&", &p));
+    assert(!parse_predicate("v5 == 1 || v6 == 2", &p));
+
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    assert(parse_predicate("v5 == 3 && mem[0x300] > 1", &p));
+    cpu->v[5] = 3;
+    assert(!predicate_holds(&p, c, cpu));
+    c->mem[0x300] = 2;
+    assert(predicate_holds(&p, c, cpu));
+    free(cpu);
+    free(c);
+
+    printf("TEST_PARSE_PREDICATE PASS\n");
+}
+
+// The shortest input opens the lock in three steps, and replaying it does.
+void test_shortest_path() {
+    snapshot* s = load_lock();
+    predicate goal;
+    assert(parse_predicate("v5 == 3", &goal));
+    search_options opts = lock_options(&goal);
+
+    for (int threads = 1; threads <= 4; threads *= 4) {
+        opts.threads = threads;
+        search_result result;
+        assert(search_run(s, &opts, &result));
+        assert(result.found && !result.full);
+        assert(result.depth == 3);
+        assert(result.path[0] == 1 << 1 && result.path[1] == 1 << 2 && result.path[2] == 1 << 3);
+
+        chip* c = malloc(sizeof(chip));
+        CPU cpu;
+        snapshot_restore(s, c, &cpu);
+        for (int step = 0; step < result.depth; step++) {
+            c->keys = result.path[step];
+            for (int i = 0; i < opts.instructions_per_frame; i++) {
+                cycle(c, &cpu);
+            }
+        }
+        assert(predicate_holds(&goal, c, &cpu));
+
+        free(c);
+        free(result.path);
+    }
+
+    free(s);
+
+    printf("TEST_SHORTEST_PATH PASS\n");
+}
+
+// A counter that only lives in memory: each step holding key 1 adds one
+// to the byte at 300, leaving no trace in the registers.
+static const uint8_t counter_rom[] = {
+    0x61, 0x01, // 200: LD V1, 1
+    0xA3, 0x00, // 202: LD I, 300
+    0xE1, 0x9E, // 204: SKP V1
+    0x12, 0x14, // 206: JP 214
+    0xF0, 0x65, // 208: LD V0, [I]
+    0x70, 0x01, // 20A: ADD V0, 1
+    0xF0, 0x55, // 20C: LD [I], V0
+    0x60, 0x00, // 20E: LD V0, 0
+    0x62, 0x01, // 210: LD V2, 1
+    0xF2, 0x15, // 212: LD DT, V2
+    0xF2, 0x07, // 214: LD V2, DT
+    0x32, 0x00, // 216: SE V2, 0
+    0x12, 0x14, // 218: JP 214
+    0x12, 0x04, // 21A: JP 204
+};
+
+// States that differ only in memory are told apart.
+void test_memory_state() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    c->planes = 1;
+    for (size_t i = 0; i < sizeof(counter_rom); i++) {
+        c->mem[0x200 + i] = counter_rom[i];
+    }
+    snapshot* s = malloc(sizeof(snapshot));
+    snapshot_save(s, c, cpu);
+    free(cpu);
+    free(c);
+
+    predicate goal;
+    assert(parse_predicate("mem[0x300] == 3", &goal));
+    search_options opts = lock_options(&goal);
+
+    search_result result;
+    assert(search_run(s, &opts, &result));
+    assert(result.found);
+    assert(result.depth == 3);
+    for (int step = 0; step < result.depth; step++) {
+        assert(result.path[step] == 1 << 1);
+    }
+
+    free(result.path);
+    free(s);
+
+    printf("TEST_MEMORY_STATE PASS\n");
+}
+
+// Pruned states aren't searched past, and a search with nothing new left
+// to reach stops on its own.
+void test_prune() {
+    snapshot* s = load_lock();
+    predicate goal;
+    predicate prune;
+    assert(parse_predicate("v5 == 3", &goal));
+    assert(parse_predicate("v5 == 2", &prune));
+    search_options opts = lock_options(&goal);
+    opts.prune = &prune;
+
+    search_result result;
+    assert(search_run(s, &opts, &result));
+    assert(!result.found && !result.full);
+    assert(result.states > 1 && result.states < 1000);
+
+    free(s);
+
+    printf("TEST_PRUNE PASS\n");
+}
+
+// Running out of room for states ends the search.
+void test_full() {
+    snapshot* s = load_lock();
+    predicate goal;
+    assert(parse_predicate("v5 == 3", &goal));
+    search_options opts = lock_options(&goal);
+    opts.max_states = 3;
+
+    search_result result;
+    assert(search_run(s, &opts, &result));
+    assert(!result.found && result.full);
+    assert(result.states == 3);
+
+    free(s);
+
+    printf("TEST_FULL PASS\n");
+}
+
+int main() {
+    test_parse_predicate();
+    test_shortest_path();
+    test_memory_state();
+    test_prune();
+    test_full();
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/stats.h"
+
+// Counters published by the emulator are visible through a reader mapping.
+void test_publish_and_read() {
+    stats* s = stats_create("test.ch8");
+    assert(s != NULL);
+
+    stats_segment* seg = stats_map(getpid());
+    assert(seg != NULL);
+
+    // 90 frames at 16.6ms, 10 slow ones at 40ms
+    for (int i = 0; i < 100; i++) {
+        stats_frame(s, 1000, 2, i < 90 ? 16600000 : 40000000, 50000, 1);
+    }
+
+    stats_segment snap;
+    stats_snapshot(seg, &snap);
+    assert(snap.pid == getpid());
+    assert(strcmp(snap.rom, "test.ch8") == 0);
+    assert(snap.frames == 100);
+    assert(snap.instructions == 100000);
+    assert(snap.draw_calls == 200);
+    assert(snap.last_frame_draw_calls == 2);
+    assert(snap.sleep_overshoot_ns == 5000000);
+    assert((snap.seq & 1) == 0);
+
+    assert(stats_percentile(snap.frame_time, 50) == 16.7);
+    assert(stats_percentile(snap.frame_time, 99) == 40.1);
+
+    stats_unmap(seg);
+    stats_destroy(s);
+    assert(stats_map(getpid()) == NULL);
+
+    printf("TEST_PUBLISH_AND_READ PASS\n");
+}
+
+int main() {
+    test_publish_and_read();
+}
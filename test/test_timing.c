@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/cpu.h"
+#include "../src/timing.h"
+
+// Runs one instruction and charges it to the clock, like the frontend.
+static int step(emu_clock* t, chip* c, CPU* cpu) {
+    uint16_t pc = cpu->pc;
+    uint16_t data = (uint16_t)(c->mem[pc] << 8 | c->mem[(uint16_t)(pc + 1)]);
+    cycle(c, cpu);
+    return clock_step(t, cpu, pc, data);
+}
+
+// The fixed model ticks the timers after a set number of instructions.
+void test_fixed_frames() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    emu_clock t;
+    clock_init(&t, TIMING_FIXED, 10);
+
+    // JP 200
+    c->mem[0x200] = 0x12;
+    c->mem[0x201] = 0x00;
+    cpu->dt = 3;
+    cpu->st = 1;
+
+    for (int i = 0; i < 9; i++) {
+        assert(step(&t, c, cpu) == 0);
+    }
+    assert(step(&t, c, cpu) == 1);
+    assert(cpu->dt == 2 && cpu->st == 0);
+
+    for (int i = 0; i < 20; i++) {
+        step(&t, c, cpu);
+    }
+    assert(t.frames == 3);
+    assert(cpu->dt == 0);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_FIXED_FRAMES PASS\n");
+}
+
+// VIP costs depend on the instruction, and taken skips cost more.
+void test_vip_costs() {
+    assert(instruction_cycles(TIMING_VIP, 0x6012, 0) < instruction_cycles(TIMING_VIP, 0x8124, 0));
+    assert(instruction_cycles(TIMING_VIP, 0x3012, 1) > instruction_cycles(TIMING_VIP, 0x3012, 0));
+    assert(instruction_cycles(TIMING_VIP, 0xFF55, 0) > instruction_cycles(TIMING_VIP, 0xF055, 0));
+    assert(instruction_cycles(TIMING_FIXED, 0xFF55, 0) == 1);
+
+    printf("TEST_VIP_COSTS PASS\n");
+}
+
+// A draw on the VIP waits for the next frame, however early in this one it starts.
+void test_vip_draw_waits() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    c->planes = 1;
+    emu_clock t;
+    clock_init(&t, TIMING_VIP, 0);
+
+    // LD V0, 1; DRW V0, V0, 1; JP 202
+    uint8_t program[] = {0x60, 0x01, 0xD0, 0x01, 0x12, 0x02};
+    for (int i = 0; i < sizeof(program); i++) {
+        c->mem[0x200 + i] = program[i];
+    }
+    cpu->dt = 10;
+
+    assert(step(&t, c, cpu) == 0);
+    assert(step(&t, c, cpu) == 1);
+    assert(cpu->dt == 9);
+    assert(t.elapsed == instruction_cycles(TIMING_VIP, 0xD001, 0));
+
+    // Every draw is one frame, so the timer runs out after 9 more
+    for (int i = 0; i < 18; i++) {
+        step(&t, c, cpu);
+    }
+    assert(t.frames == 10);
+    assert(cpu->dt == 0);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_VIP_DRAW_WAITS PASS\n");
+}
+
+// Without draws, a frame holds as many instructions as fit in its cycles.
+void test_vip_frame_length() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+    emu_clock t;
+    clock_init(&t, TIMING_VIP, 0);
+
+    // ADD V1, 1; JP 200
+    c->mem[0x200] = 0x71;
+    c->mem[0x201] = 0x01;
+    c->mem[0x202] = 0x12;
+    c->mem[0x203] = 0x00;
+
+    int instructions = 0;
+    while (t.frames == 0) {
+        step(&t, c, cpu);
+        instructions++;
+    }
+
+    uint32_t pair = instruction_cycles(TIMING_VIP, 0x7101, 0) + instruction_cycles(TIMING_VIP, 0x1200, 0);
+    int expected = (VIP_FRAME_CYCLES - VIP_DISPLAY_CYCLES + pair - 1) / pair * 2;
+    assert(instructions >= expected - 1 && instructions <= expected);
+
+    free(cpu);
+    free(c);
+
+    printf("TEST_VIP_FRAME_LENGTH PASS\n");
+}
+
+int main() {
+    test_fixed_frames();
+    test_vip_costs();
+    test_vip_draw_waits();
+    test_vip_frame_length();
+
+    return 0;
+}
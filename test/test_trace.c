@@ -0,0 +1,109 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/cpu.h"
+#include "../src/trace.h"
+
+// Records a small looping program and checks that the decoded trace matches.
+void test_trace_roundtrip() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    // LD V0, 123; LD I, 0x300; LD B, V0; JP 0x200
+    uint8_t rom[] = {0x60, 123, 0xA3, 0x00, 0xF0, 0x33, 0x12, 0x00};
+    memcpy(&c->mem[0x200], rom, sizeof(rom));
+
+    char filename[] = "/tmp/chip8-trace-XXXXXX";
+    close(mkstemp(filename));
+
+    trace* t = trace_open(filename);
+    assert(t != NULL);
+    for (int i = 0; i < 4000; i++) {
+        trace_cycle(t, c, cpu);
+    }
+    assert(trace_close(t) == 4000);
+
+    trace_reader* r = trace_reader_open(filename);
+    assert(r != NULL);
+
+    trace_record rec;
+    for (int i = 0; i < 4000; i++) {
+        assert(trace_reader_next(r, &rec));
+        assert(rec.pc == 0x200 + (i % 4) * 2);
+        assert(rec.opcode == (rom[(i % 4) * 2] << 8 | rom[(i % 4) * 2 + 1]));
+
+        switch (i % 4) {
+            case 0:
+                assert(rec.v[0] == 123);
+                break;
+            case 1:
+                assert(rec.address == 0x300);
+                break;
+            case 2:
+                assert(rec.mem_count == 3);
+                assert(rec.mem_address == 0x300);
+                assert(rec.mem[0] == 1 && rec.mem[1] == 2 && rec.mem[2] == 3);
+                break;
+            case 3:
+                assert(rec.next_pc == 0x200);
+                break;
+        }
+    }
+    assert(!trace_reader_next(r, &rec));
+
+    trace_reader_close(r);
+    remove(filename);
+    free(cpu);
+    free(c);
+
+    printf("TEST_TRACE_ROUNDTRIP PASS\n");
+}
+
+// A store that runs past the end of memory is recorded in full, wrapping to 0.
+void test_trace_wrapped_store() {
+    chip* c = calloc(1, sizeof(chip));
+    CPU* cpu = initialize();
+
+    // LD [I], V3 with I two bytes from the end of memory
+    c->mem[0x200] = 0xF3;
+    c->mem[0x201] = 0x55;
+    for (int i = 0; i < 4; i++) {
+        cpu->v[i] = i + 1;
+    }
+    cpu->address = 0xFFFE;
+
+    char filename[] = "/tmp/chip8-trace-XXXXXX";
+    close(mkstemp(filename));
+
+    trace* t = trace_open(filename);
+    assert(t != NULL);
+    trace_cycle(t, c, cpu);
+    assert(trace_close(t) == 1);
+    assert(c->mem[0xFFFF] == 2 && c->mem[0] == 3);
+
+    trace_reader* r = trace_reader_open(filename);
+    assert(r != NULL);
+
+    trace_record rec;
+    assert(trace_reader_next(r, &rec));
+    assert(rec.flags & TRACE_MEM);
+    assert(rec.mem_address == 0xFFFE && rec.mem_count == 4);
+    for (int i = 0; i < 4; i++) {
+        assert(rec.mem[i] == i + 1);
+    }
+    assert(!trace_reader_next(r, &rec));
+
+    trace_reader_close(r);
+    remove(filename);
+    free(cpu);
+    free(c);
+
+    printf("TEST_TRACE_WRAPPED_STORE PASS\n");
+}
+
+int main() {
+    test_trace_roundtrip();
+    test_trace_wrapped_store();
+}